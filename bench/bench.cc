@@ -0,0 +1,344 @@
+#include "application.hpp"
+
+/* drives the application for a fixed number of frames (or seconds) in a fixed
+   configuration and writes throughput, latency percentiles and startup phase
+   timings as json, so runs can be diffed against each other */
+
+static void writePercentiles( ostream &os, const char *name, const Percentiles &p )
+{
+	os << "    \"" << name << "\": { \"p50\": " << p.p50
+	   << ", \"p95\": " << p.p95
+	   << ", \"p99\": " << p.p99 << " }";
+}
+
+// a json string literal, for names and paths that may hold quotes, backslashes or control characters
+static string jsonString( const string &value )
+{
+	string out = "\"";
+	for ( unsigned char c : value ) {
+		if ( c == '"' || c == '\\' ) {
+			out += '\\';
+			out += char( c );
+		} else if ( c < 0x20 ) {
+			char escaped[ 8 ];
+			snprintf( escaped, sizeof( escaped ), "\\u%04x", c );
+			out += escaped;
+		} else {
+			out += char( c );
+		}
+	}
+	return out + "\"";
+}
+
+// runs that broke what the bench checks, any of them makes it exit nonzero
+static uint32_t failed_runs = 0;
+
+/* one json object describing a finished run, its throughput also through
+   fps; options are validated again since sweeps change them after parsing */
+static string runBench( Options options, double *fps_out = nullptr )
+{
+	finalizeOptions( options );
+	Application app( options );
+
+	auto start = chrono::steady_clock::now();
+	app.run();
+	chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+	auto frames = app.getFrameNumber();
+	auto fps = frames / elapsed.count();
+	if ( fps_out ) {
+		*fps_out = fps;
+	}
+	auto &profiler = app.getProfiler();
+	auto window = static_cast<size_t>( frames );
+
+	ostringstream os;
+	os << "{\n"
+	   << "  \"config\": {\n"
+	   << "    \"device\": " << jsonString( app.getDeviceName() ) << ",\n"
+	   << "    \"present_mode\": \"" << app.getPresentModeName() << "\",\n"
+	   << "    \"frames_in_flight\": " << options.frames_in_flight << ",\n"
+	   << "    \"max_fps\": " << options.max_fps << ",\n"
+	   << "    \"target_latency_ms\": " << options.target_latency_ms << ",\n"
+	   << "    \"low_latency\": " << ( options.low_latency ? "true" : "false" ) << ",\n"
+	   << "    \"swapchain_images\": " << options.swapchain_images << ",\n"
+	   << "    \"width\": " << options.width << ",\n"
+	   << "    \"height\": " << options.height << ",\n"
+	   << "    \"draw_count\": " << options.draw_count << ",\n"
+	   << "    \"mesh_triangles\": " << options.mesh_triangles << ",\n"
+	   << "    \"instance_count\": " << options.instance_count << ",\n"
+	   << "    \"cull_mode\": \"" << cullModeName( options.cull_mode ) << "\",\n"
+	   << "    \"post\": \"" << postModeName( options.post_mode ) << "\",\n"
+	   << "    \"views\": " << options.views << ",\n"
+	   << "    \"view_mode\": \"" << viewModeName( options.view_mode ) << "\",\n"
+	   << "    \"mesh_file\": " << jsonString( options.mesh_file ) << ",\n"
+	   << "    \"io_threads\": " << options.io_threads << ",\n"
+	   << "    \"pipeline_variants\": " << options.pipeline_variants << ",\n"
+	   << "    \"record_threads\": " << options.record_threads << ",\n"
+	   << "    \"capture\": \"" << ( options.capture_path.empty() ? "off" : captureFormatName( options.capture_format ) ) << "\",\n"
+	   << "    \"capture_buffers\": " << options.capture_buffers << ",\n"
+	   << "    \"stress\": " << ( options.stress ? "true" : "false" ) << ",\n"
+	   << "    \"resize_every\": " << options.resize_every << "\n"
+	   << "  },\n"
+	   << "  \"frames\": " << frames << ",\n"
+	   << "  \"seconds\": " << elapsed.count() << ",\n"
+	   << "  \"fps\": " << fps << ",\n"
+	   << "  \"latency_ms\": {\n";
+	writePercentiles( os, "frame", profiler.frameTimes( window ) );
+	os << ",\n";
+	writePercentiles( os, "gpu", profiler.gpuTimes( window ) );
+	for ( size_t i = 0; i < PROFILE_STAGE_COUNT; ++i ) {
+		auto stage = static_cast<ProfileStage>( i );
+		os << ",\n";
+		writePercentiles( os, profileStageName( stage ), profiler.stageTimes( stage, window ) );
+	}
+	os << "\n  },\n"
+	   << "  \"startup_ms\": {\n";
+	auto &phases = app.getStartupPhases();
+	for ( size_t i = 0; i < phases.size(); ++i ) {
+		os << "    \"" << phases[ i ].first << "\": " << phases[ i ].second
+		   << ( i + 1 < phases.size() ? ",\n" : "\n" );
+	}
+	auto &image_stats = app.getImageStats();
+	os << "  },\n"
+	   << "  \"image_tracking\": {\n"
+	   << "    \"reuses\": " << image_stats.tracked << ",\n"
+	   << "    \"conflicts\": " << image_stats.conflicts << ",\n"
+	   << "    \"wait_ms\": " << image_stats.wait_ms << ",\n"
+	   << "    \"hazards\": " << image_stats.hazards << "\n"
+	   << "  },\n"
+	   << "  \"resize\": {\n"
+	   << "    \"count\": " << app.getRecreateTimes().size() << ",\n"
+	   << "    \"pipeline_rebuilds\": " << app.getPipelineRebuilds() << ",\n";
+	writePercentiles( os, "stall_ms", computePercentiles( app.getRecreateTimes() ) );
+	auto pso = app.getPipelineStats();
+	os << "\n  },\n"
+	   << "  \"pipelines\": {\n"
+	   << "    \"requests\": " << pso.requests << ",\n"
+	   << "    \"deduplicated\": " << pso.deduplicated << ",\n"
+	   << "    \"compiled\": " << pso.compiled << ",\n"
+	   << "    \"batches\": " << pso.batches << ",\n"
+	   << "    \"failed\": " << pso.failed << ",\n"
+	   << "    \"fallbacks\": " << pso.fallbacks << "\n"
+	   << "  },\n";
+	auto pacing = app.getPacingStats();
+	os << "  \"pacing\": {\n"
+	   << "    \"paced_frames\": " << pacing.paced << ",\n"
+	   << "    \"wait_ms\": " << pacing.wait_ms << ",\n"
+	   << "    \"cpu_ms\": " << pacing.cpu_ms << ",\n"
+	   << "    \"gpu_ms\": " << pacing.gpu_ms << ",\n";
+	writePercentiles( os, "input_latency_ms", pacing.latency_ms );
+	os << "\n  },\n";
+	auto capture = app.getCaptureStats();
+	os << "  \"capture\": {\n"
+	   << "    \"captured\": " << capture.captured << ",\n"
+	   << "    \"dropped\": " << capture.dropped << ",\n"
+	   << "    \"failed\": " << capture.failed << ",\n"
+	   << "    \"bytes_written\": " << capture.bytes_written << ",\n"
+	   << "    \"write_ms\": " << capture.write_ms << "\n"
+	   << "  },\n";
+	auto memory = app.getMemoryStats();
+	os << "  \"memory\": {\n"
+	   << "    \"device_allocations\": " << memory.block_count << ",\n"
+	   << "    \"reserved_bytes\": " << memory.reserved_bytes << ",\n"
+	   << "    \"used_bytes\": " << memory.used_bytes << ",\n"
+	   << "    \"resources\": " << memory.allocation_count << ",\n"
+	   << "    \"fragmentation\": " << memory.fragmentation << ",\n"
+	   << "    \"linear_region_bytes\": " << memory.linear_region_bytes << ",\n"
+	   << "    \"linear_peak_bytes\": " << memory.linear_peak_bytes << "\n"
+	   << "  }\n"
+	   << "}";
+
+	cout << frames << " frames in " << elapsed.count() << " s, "
+		 << fps << " frames/s" << endl;
+	// the extent is dynamic state, a resize must never cost a pipeline
+	if ( options.resize_every && app.getPipelineRebuilds() ) {
+		cerr << "resize: pipeline rebuilt " << app.getPipelineRebuilds() << " times, expected none" << endl;
+		++failed_runs;
+	}
+	return os.str();
+}
+
+// nests a run object one level deeper
+static string indent( const string &json )
+{
+	string out;
+	for ( auto c : json ) {
+		out += c;
+		if ( c == '\n' ) {
+			out += "    ";
+		}
+	}
+	return out;
+}
+
+int main( int argc, char **argv )
+{
+	Options options;
+	options.headless = true;
+	options.width = 1280;
+	options.height = 720;
+	string out = "bench.json";
+	// sweep recording over 1..n threads, 0 runs once
+	uint32_t thread_sweep = 0;
+	// writes the --mesh-triangles mesh here for --mesh-file runs instead of benchmarking
+	string write_mesh;
+	// cpu against gpu culling over growing worlds
+	bool cull_sweep = false;
+	// no capture against every capture format, written under this directory
+	string capture_sweep;
+	// no post processing against post processing on the graphics and on the compute queue
+	bool post_sweep = false;
+	// one pass per view against multiview, over 2, 4 and 8 views
+	bool view_sweep = false;
+
+	for ( int i = 1; i < argc; ++i ) {
+		string arg = argv[ i ];
+		if ( arg == "--windowed" ) {
+			options.headless = false;
+		} else if ( arg == "--out" && i + 1 < argc ) {
+			out = argv[ ++i ];
+		} else if ( arg == "--thread-sweep" && i + 1 < argc ) {
+			thread_sweep = stoul( argv[ ++i ] );
+		} else if ( arg == "--write-mesh" && i + 1 < argc ) {
+			write_mesh = argv[ ++i ];
+		} else if ( arg == "--cull-sweep" ) {
+			cull_sweep = true;
+		} else if ( arg == "--view-sweep" ) {
+			view_sweep = true;
+		} else if ( arg == "--post-sweep" ) {
+			post_sweep = true;
+		} else if ( arg == "--capture-sweep" && i + 1 < argc ) {
+			capture_sweep = argv[ ++i ];
+		} else if ( !parseOption( options, i, argc, argv ) ) {
+			throw std::runtime_error( "unknown argument: " + arg );
+		}
+	}
+	if ( !options.frame_count && options.duration <= 0 ) {
+		options.frame_count = 1000;
+	}
+	finalizeOptions( options );
+	// each sweep owns the options it varies, so they do not combine
+	auto sweeps = int( thread_sweep > 0 ) + int( cull_sweep ) + int( view_sweep ) + int( post_sweep ) +
+				  int( !capture_sweep.empty() );
+	if ( sweeps > 1 ) {
+		throw std::runtime_error( "only one of --thread-sweep, --cull-sweep, --view-sweep, --post-sweep "
+								  "and --capture-sweep can be given" );
+	}
+
+	if ( !write_mesh.empty() ) {
+		writeMeshFile( write_mesh, buildTriangleMesh( options.mesh_triangles ) );
+		cout << "mesh of " << options.mesh_triangles << " triangles written to " << write_mesh << endl;
+		return 0;
+	}
+
+	ofstream os( out, ios::trunc );
+	if ( !os.is_open() ) {
+		throw std::runtime_error( "failed to open bench output file" );
+	}
+
+	if ( !capture_sweep.empty() ) {
+		if ( mkdir( capture_sweep.c_str(), 0755 ) != 0 && errno != EEXIST ) {
+			throw std::runtime_error( "failed to create " + capture_sweep );
+		}
+		os << "{\n"
+		   << "  \"sweep\": \"capture\",\n"
+		   << "  \"runs\": [";
+		options.capture_path.clear();
+		cout << "no capture: ";
+		double baseline_fps = 0;
+		os << "\n    " << indent( runBench( options, &baseline_fps ) );
+
+		// what capturing adds to every frame, against the run without it
+		ostringstream overhead;
+		for ( auto format : { CaptureFormat::Raw, CaptureFormat::Png, CaptureFormat::Container } ) {
+			options.capture_format = format;
+			options.capture_path = capture_sweep + "/" +
+								   ( format == CaptureFormat::Container ? "capture.bin" : captureFormatName( format ) );
+			cout << captureFormatName( format ) << " capture: ";
+			double fps = 0;
+			os << ",\n    " << indent( runBench( options, &fps ) );
+			auto ms = 1000. / fps - 1000. / baseline_fps;
+			cout << "  " << ms << " ms per frame over no capture" << endl;
+			overhead << ( format == CaptureFormat::Raw ? "\n" : ",\n" )
+					 << "    \"" << captureFormatName( format ) << "\": " << ms;
+		}
+		os << "\n  ],\n"
+		   << "  \"overhead_ms\": {" << overhead.str() << "\n  }\n"
+		   << "}\n";
+	} else if ( view_sweep ) {
+		os << "{\n"
+		   << "  \"sweep\": \"views\",\n"
+		   << "  \"runs\": [";
+		// sequential views cannot use worker threads, so neither run does
+		options.record_threads = 0;
+		ostringstream gains;
+		auto first = true;
+		for ( uint32_t views : { 2u, 4u, 8u } ) {
+			options.views = views;
+			double fps[ 2 ] = {};
+			for ( auto mode : { ViewMode::Sequential, ViewMode::Multiview } ) {
+				options.view_mode = mode;
+				cout << views << " views, " << viewModeName( mode ) << ": ";
+				os << ( first ? "\n    " : ",\n    " )
+				   << indent( runBench( options, &fps[ mode == ViewMode::Multiview ] ) );
+				first = false;
+			}
+			cout << "  multiview over sequential: " << fps[ 1 ] / fps[ 0 ] << "x" << endl;
+			gains << ( views == 2 ? "\n" : ",\n" )
+				  << "    \"" << views << "\": " << fps[ 1 ] / fps[ 0 ];
+		}
+		os << "\n  ],\n"
+		   << "  \"multiview_gain\": {" << gains.str() << "\n  }\n"
+		   << "}\n";
+	} else if ( post_sweep ) {
+		os << "{\n"
+		   << "  \"sweep\": \"post\",\n"
+		   << "  \"runs\": [";
+		double fps[ 3 ] = {};
+		for ( auto mode : { PostMode::Off, PostMode::Serial, PostMode::Async } ) {
+			options.post_mode = mode;
+			cout << "post processing " << postModeName( mode ) << ": ";
+			auto i = static_cast<int>( mode );
+			os << ( i ? ",\n    " : "\n    " ) << indent( runBench( options, &fps[ i ] ) );
+		}
+		// above 1 when post processing overlapped the next frame's rendering
+		auto gain = fps[ 2 ] / fps[ 1 ];
+		cout << "async over serial: " << gain << "x" << endl;
+		os << "\n  ],\n"
+		   << "  \"overlap_gain\": " << gain << "\n"
+		   << "}\n";
+	} else if ( cull_sweep ) {
+		os << "{\n"
+		   << "  \"sweep\": \"cull\",\n"
+		   << "  \"runs\": [";
+		auto first = true;
+		for ( uint32_t objects : { 10000u, 100000u, 1000000u } ) {
+			for ( auto mode : { CullMode::Cpu, CullMode::Gpu } ) {
+				options.instance_count = objects;
+				options.cull_mode = mode;
+				cout << objects << " objects, " << cullModeName( mode ) << " culling: ";
+				os << ( first ? "\n    " : ",\n    " ) << indent( runBench( options ) );
+				first = false;
+			}
+		}
+		os << "\n  ]\n"
+		   << "}\n";
+	} else if ( thread_sweep ) {
+		os << "{\n"
+		   << "  \"sweep\": \"record_threads\",\n"
+		   << "  \"runs\": [";
+		for ( uint32_t threads = 1; threads <= thread_sweep; ++threads ) {
+			options.record_threads = threads;
+			cout << "recording with " << threads << " threads: ";
+			os << ( threads > 1 ? ",\n    " : "\n    " ) << indent( runBench( options ) );
+		}
+		os << "\n  ]\n"
+		   << "}\n";
+	} else {
+		os << runBench( options ) << "\n";
+	}
+
+	cout << "results written to " << out << endl;
+	return failed_runs ? 1 : 0;
+}
@@ -0,0 +1,41 @@
+# Compiles one shader to SPIR-V, run with cmake -P from the shaders target.
+#
+#   -DGLSLANG=<glslangValidator> -DSOURCE=<shader> -DSTAGE=<vert|frag|comp>
+#   -DOUTPUT=<spv> -DCACHE_DIR=<dir> -DSTAMP=<file>
+#
+# Compiled code is cached under CACHE_DIR by a hash of the source and the
+# command, so touching a shader, switching branches or undoing an edit
+# never runs the compiler again. OUTPUT is only replaced when its content
+# changes, and then atomically, since a running app may be watching it.
+
+file(SHA256 "${SOURCE}" source_hash)
+string(SHA256 key "${source_hash} ${STAGE} ${GLSLANG}")
+set(cached "${CACHE_DIR}/${key}.spv")
+
+if(NOT EXISTS "${cached}")
+  file(MAKE_DIRECTORY "${CACHE_DIR}")
+  execute_process(
+    COMMAND "${GLSLANG}" -V -S ${STAGE} "${SOURCE}" -o "${cached}.tmp"
+    RESULT_VARIABLE result
+    OUTPUT_VARIABLE log
+    ERROR_VARIABLE log)
+  if(NOT result EQUAL 0)
+    file(REMOVE "${cached}.tmp")
+    message(FATAL_ERROR "failed to compile ${SOURCE}:\n${log}")
+  endif()
+  file(RENAME "${cached}.tmp" "${cached}")
+  message(STATUS "compiled ${SOURCE}")
+endif()
+
+set(current "")
+if(EXISTS "${OUTPUT}" AND EXISTS "${STAMP}")
+  file(READ "${STAMP}" current)
+endif()
+if(NOT current STREQUAL key)
+  get_filename_component(cached_name "${cached}" NAME)
+  get_filename_component(output_dir "${OUTPUT}" DIRECTORY)
+  file(COPY "${cached}" DESTINATION "${output_dir}")
+  file(RENAME "${output_dir}/${cached_name}" "${OUTPUT}")
+endif()
+# rewritten every run, it is what the build compares against the source
+file(WRITE "${STAMP}" "${key}")
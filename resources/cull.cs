@@ -0,0 +1,48 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(local_size_x = 64) in;
+
+struct Instance {
+    // offset xy, scale, rotation
+    vec4 transform;
+    vec4 color;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Objects {
+    Instance objects[];
+};
+
+layout(std430, set = 0, binding = 1) writeonly buffer Visible {
+    Instance visible[];
+};
+
+// a VkDrawIndexedIndirectCommand, instanceCount is bumped per visible object
+layout(std430, set = 0, binding = 2) buffer Draw {
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+} draw;
+
+layout(push_constant) uniform View {
+    vec2 center;
+    float halfExtent;
+    uint objectCount;
+} view;
+
+void main() {
+    uint id = gl_GlobalInvocationID.x;
+    if (id >= view.objectCount) {
+        return;
+    }
+    Instance object = objects[id];
+    // scale doubles as the bounding radius
+    vec2 distance = abs(object.transform.xy - view.center);
+    if (any(greaterThan(distance, vec2(view.halfExtent + object.transform.z)))) {
+        return;
+    }
+    // copied as is, the vertex shader applies the view
+    visible[atomicAdd(draw.instanceCount, 1)] = object;
+}
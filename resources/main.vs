@@ -1,21 +1,30 @@
-#version 450
-#extension GL_ARB_separate_shader_objects : enable
-
-layout(location = 0) out vec3 fragColor;
-
-vec2 positions[3] = vec2[](
-    vec2(0.0, -0.5),
-    vec2(0.5, 0.5),
-    vec2(-0.5, 0.5)
-);
-
-vec3 colors[3] = vec3[](
-    vec3(1.0, 0.0, 0.0),
-    vec3(0.0, 1.0, 0.0),
-    vec3(0.0, 0.0, 1.0)
-);
-
-void main() {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-    fragColor = colors[gl_VertexIndex];
-}
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+// offset xy, scale, rotation
+layout(location = 2) in vec4 inTransform;
+layout(location = 3) in vec4 inInstanceColor;
+
+layout(location = 0) out vec3 fragColor;
+
+layout(set = 0, binding = 0) uniform Frame {
+    vec2 viewCenter;
+    float viewScale;
+    float time;
+} frame;
+
+layout(push_constant) uniform Draw {
+    float depth;
+} draw;
+
+void main() {
+    float c = cos(inTransform.w);
+    float s = sin(inTransform.w);
+    vec2 position = mat2(c, s, -s, c) * (inPosition * inTransform.z) + inTransform.xy;
+    // instances are in world space, the frame's view takes them to clip space
+    position = (position - frame.viewCenter) * frame.viewScale;
+    gl_Position = vec4(position, draw.depth, 1.0);
+    fragColor = inColor * inInstanceColor.rgb;
+}
@@ -0,0 +1,34 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(set = 0, binding = 0) uniform sampler2D scene;
+layout(set = 0, binding = 1, rgba8) uniform writeonly image2D result;
+
+layout(push_constant) uniform Post {
+    float exposure;
+    // distance between blur taps, in texels
+    float spread;
+} post;
+
+// 3x3 gaussian blur of the scene, then a reinhard tonemap
+void main() {
+    ivec2 size = imageSize(result);
+    ivec2 id = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(id, size))) {
+        return;
+    }
+    vec2 texel = 1.0 / vec2(size);
+    vec2 uv = (vec2(id) + 0.5) * texel;
+    const float weights[3] = float[](0.25, 0.5, 0.25);
+    vec3 color = vec3(0.0);
+    for (int y = -1; y <= 1; ++y) {
+        for (int x = -1; x <= 1; ++x) {
+            vec2 offset = vec2(x, y) * post.spread * texel;
+            color += weights[x + 1] * weights[y + 1] * texture(scene, uv + offset).rgb;
+        }
+    }
+    color *= post.exposure;
+    imageStore(result, id, vec4(color / (1.0 + color), 1.0));
+}
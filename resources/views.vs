@@ -0,0 +1,32 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_multiview : enable
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+// offset xy, scale, rotation
+layout(location = 2) in vec4 inTransform;
+layout(location = 3) in vec4 inInstanceColor;
+
+layout(location = 0) out vec3 fragColor;
+
+// world to clip space of every view
+layout(set = 1, binding = 0) uniform Views {
+    mat4 viewProj[8];
+} views;
+
+layout(push_constant) uniform Draw {
+    float depth;
+    // the view of a pass drawing one view at a time, 0 with multiview
+    uint view;
+} draw;
+
+void main() {
+    float c = cos(inTransform.w);
+    float s = sin(inTransform.w);
+    vec2 position = mat2(c, s, -s, c) * (inPosition * inTransform.z) + inTransform.xy;
+    // gl_ViewIndex is 0 outside of a multiview pass
+    vec4 clip = views.viewProj[draw.view + gl_ViewIndex] * vec4(position, 0.0, 1.0);
+    gl_Position = vec4(clip.xy, draw.depth * clip.w, clip.w);
+    fragColor = inColor * inInstanceColor.rgb;
+}
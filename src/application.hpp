@@ -0,0 +1,3559 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <set>
+#include <map>
+#include <optional>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <sstream>
+#include <iomanip>
+#include <functional>
+#include <utility>
+#include <random>
+#include <thread>
+#include <algorithm>
+#include <memory>
+#include <atomic>
+#include <deque>
+#include <cerrno>
+#include <cmath>
+#include <array>
+
+#include <sys/stat.h>
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include "capture.hpp"
+#include "deletion.hpp"
+#include "descriptors.hpp"
+#include "device_select.hpp"
+#include "instances.hpp"
+#include "loader.hpp"
+#include "memory.hpp"
+#include "mesh.hpp"
+#include "pacing.hpp"
+#include "profiler.hpp"
+#include "pso.hpp"
+#include "render_graph.hpp"
+#include "upload.hpp"
+#include "watcher.hpp"
+#include "worker_pool.hpp"
+
+using namespace std;
+using namespace glm;
+
+// using namespace vk;
+
+inline vector<const char *> device_extensions = {
+	VK_KHR_SWAPCHAIN_EXTENSION_NAME
+};
+
+struct QueueFamilyIndices
+{
+	optional<uint32_t> graphics_family;
+	optional<uint32_t> present_family;
+	// a transfer-only family when the device has one, the graphics family otherwise
+	optional<uint32_t> transfer_family;
+	// a compute family without graphics when the device has one, the graphics family otherwise
+	optional<uint32_t> compute_family;
+};
+
+struct SwapchainSupportDetails
+{
+	vk::SurfaceCapabilitiesKHR capabilities;
+	vector<vk::SurfaceFormatKHR> formats;
+	vector<vk::PresentModeKHR> present_modes;
+};
+
+struct ImageTrackingStats
+{
+	// acquires of an image some earlier frame rendered into
+	uint64_t tracked = 0;
+	// of those, how many were still in flight and had to be waited on
+	uint64_t conflicts = 0;
+	double wait_ms = 0;
+	/* of the conflicts, those the slot wait alone would have let through:
+	   the image's last frame is newer than the frame the slot waited for.
+	   Each one is a frame that, without per image tracking, would have
+	   rendered into an image another frame was still writing */
+	uint64_t hazards = 0;
+};
+
+// per frame uniform block of main.vs, set 0 binding 0; std140 matches this layout
+struct FrameUniforms
+{
+	// world space center of the view and world to clip space scale
+	glm::vec2 view_center;
+	float view_scale;
+	// seconds since the run started
+	float time;
+};
+
+// per frame view matrices of views.vs, set 1 binding 0
+struct ViewUniforms
+{
+	static constexpr uint32_t MAX_VIEWS = 8;
+	// world to clip space, one per view
+	glm::mat4 view_proj[ MAX_VIEWS ];
+};
+
+// per draw push constants of main.vs and views.vs
+struct DrawConstants
+{
+	// draws are layered by index, back to front
+	float depth;
+	// views.vs only: the view a pass drawing one view at a time renders
+	uint32_t view;
+};
+
+// push constants of post.cs
+struct PostConstants
+{
+	float exposure;
+	// distance between blur taps, in texels
+	float spread;
+};
+
+// who decides which instances are drawn each frame
+enum class CullMode
+{
+	// every instance, moved on the cpu each frame
+	None,
+	// static world culled against the view on the cpu
+	Cpu,
+	// static world culled by a compute pass that also writes the draw
+	Gpu
+};
+
+// where the post processing pass runs, if anywhere
+enum class PostMode
+{
+	Off,
+	// a compute pass in the frame's graphics submission
+	Serial,
+	// on the compute queue, overlapping the next frame's rendering
+	Async
+};
+
+// how a frame with several camera views draws them
+enum class ViewMode
+{
+	// one render pass instance draws every view, VK_KHR_multiview
+	Multiview,
+	// a render pass instance and a full recording of the draws per view
+	Sequential
+};
+
+struct Options
+{
+	// render into app-owned images instead of a window + swapchain
+	bool headless = false;
+	uint32_t width = 800;
+	uint32_t height = 600;
+	// 0 means run until the window is closed
+	uint64_t frame_count = 0;
+	// wall clock limit in seconds, 0 means unlimited
+	double duration = 0;
+	// draw calls recorded into each command buffer
+	uint32_t draw_count = 1;
+	// threads recording secondary command buffers, 0 records inline on the main thread
+	uint32_t record_threads = 0;
+	// frames the cpu may record ahead of the gpu
+	uint32_t frames_in_flight = 2;
+	// frame starts are spaced to at most this rate, 0 means uncapped
+	double max_fps = 0;
+	// frames are only queued ahead of the gpu while this many ms cover them, 0 disables
+	double target_latency_ms = 0;
+	// delay each frame until the gpu is about to need it, sampling input as late as possible
+	bool low_latency = false;
+	// requested swapchain image count, 0 means one more than the surface minimum
+	uint32_t swapchain_images = 0;
+	// falls back to fifo when the surface does not support it
+	vk::PresentModeKHR present_mode = vk::PresentModeKHR::eMailbox;
+	// toggle between full and half extent every n frames to measure recreation, 0 disables
+	uint32_t resize_every = 0;
+	// randomize acquire timing (and offscreen acquire order) to exercise image tracking
+	bool stress = false;
+	// frame records are written here on exit, csv or json by extension
+	string profile_dump;
+	// triangles in the uploaded mesh, each draw call draws all of them
+	uint32_t mesh_triangles = 1;
+	// instances of the mesh drawn by each draw call, moved on the cpu every frame
+	uint32_t instance_count = 1;
+	// with culling the instances become a static world larger than the view
+	CullMode cull_mode = CullMode::None;
+	// streamed in instead of generating the mesh when set
+	string mesh_file;
+	// threads mapping and paging in asset files
+	uint32_t io_threads = 2;
+	// pipelines differing only in a specialization constant, draw j binds variant j % n
+	uint32_t pipeline_variants = 1;
+	// reload shaders rewritten while running and rebuild the pipelines using them
+	bool watch_shaders = false;
+	// every frame is read back and written here, a directory or with container a file
+	string capture_path;
+	CaptureFormat capture_format = CaptureFormat::Raw;
+	// readback buffers; frames are dropped rather than waited for when all are busy
+	uint32_t capture_buffers = 6;
+	// blur and tonemap the rendered frame in a compute pass before presenting it
+	PostMode post_mode = PostMode::Off;
+	// camera views drawn each frame and tiled into the target, 1 for the plain single view
+	uint32_t views = 1;
+	ViewMode view_mode = ViewMode::Multiview;
+	// part of a device name or its UUID; the best scoring device when empty
+	string device;
+	// rank devices by a short copy benchmark instead of their score
+	bool device_bench = false;
+};
+
+struct Application
+{
+	static constexpr vk::DeviceSize STAGING_RING_SIZE = 16ull << 20;
+	// half size of the culled world, the view covers [ -1, 1 ] of it
+	static constexpr float WORLD_EXTENT = 4.f;
+	static constexpr uint32_t CULL_GROUP_SIZE = 64;
+	static constexpr uint32_t PIPELINE_THREADS = 2;
+	// per slot uniform space in the frame pool, and the largest block a single bind can see
+	static constexpr vk::DeviceSize UNIFORM_REGION_SIZE = 64ull << 10;
+	static constexpr vk::DeviceSize UNIFORM_BLOCK_RANGE = sizeof( ViewUniforms );
+	// written next to the executables by the shaders build target
+	static constexpr const char *VERT_SHADER = "main.vs.spv";
+	static constexpr const char *FRAG_SHADER = "main.fs.spv";
+	static constexpr const char *CULL_SHADER = "cull.cs.spv";
+	static constexpr const char *POST_SHADER = "post.cs.spv";
+	// main.vs with per view matrices, for multiple views
+	static constexpr const char *VIEWS_SHADER = "views.vs.spv";
+	// post processing output, blitted to the target; storage support is near universal
+	static constexpr vk::Format POST_FORMAT = vk::Format::eR8G8B8A8Unorm;
+	static constexpr uint32_t POST_GROUP_SIZE = 8;
+
+	Application( const Options &options = Options() ) :
+	  options( options ),
+	  loader( options.io_threads ),
+	  base_extent{ options.width, options.height }
+	{
+		// the shaders page in while the window, instance and device come up
+		vert_shader_load = loader.load( vertexShader(), LoadPriority::Startup );
+		frag_shader_load = loader.load( FRAG_SHADER, LoadPriority::Startup );
+		if ( options.cull_mode == CullMode::Gpu ) {
+			cull_shader_load = loader.load( CULL_SHADER, LoadPriority::Startup );
+		}
+		if ( options.post_mode != PostMode::Off ) {
+			post_shader_load = loader.load( POST_SHADER, LoadPriority::Startup );
+		}
+		if ( options.watch_shaders ) {
+			shader_watcher = make_unique<FileWatcher>( "." );
+		}
+		if ( !options.headless ) {
+			timePhase( "window", [this] { initWindow(); } );
+		}
+		initVulkan();
+	}
+	/* tears down in reverse dependency order: everything the gpu may still
+	   use goes once the device is idle, resources before the memory they are
+	   bound to, and the device before the surface and the instance */
+	~Application()
+	{
+		if ( device ) {
+			device.waitIdle();
+			for ( auto &queue : retired ) {
+				queue.drain();
+			}
+			workers.reset();
+
+			// the compile threads write into the pipeline cache
+			pipelines.destroy();
+			savePipelineCache();
+			device.destroy( pipeline_cache );
+
+			capture.destroy( allocator );
+			uploader.destroy( allocator );
+			destroyBuffer( mesh.vertex_buffer, mesh.vertex_allocation );
+			destroyBuffer( mesh.index_buffer, mesh.index_allocation );
+			destroyBuffer( object_buffer, object_allocation );
+			for ( size_t i = 0; i < instance_buffers.size(); ++i ) {
+				destroyBuffer( instance_buffers[ i ], instance_allocations[ i ] );
+			}
+			for ( size_t i = 0; i < indirect_buffers.size(); ++i ) {
+				destroyBuffer( indirect_buffers[ i ], indirect_allocations[ i ] );
+			}
+			frame_pool.destroy( allocator );
+
+			// sets go with their pools
+			static_descriptors.destroy();
+			for ( auto &descriptors : frame_descriptors ) {
+				descriptors.destroy();
+			}
+			device.destroy( cull_pipeline );
+			device.destroy( cull_pipeline_layout );
+			device.destroy( cull_set_layout );
+			device.destroy( post_pipeline );
+			device.destroy( post_pipeline_layout );
+			device.destroy( post_set_layout );
+			device.destroy( post_sampler );
+			device.destroy( pipeline_layout );
+			device.destroy( frame_set_layout );
+			device.destroy( view_set_layout );
+
+			for ( size_t i = 0; i < image_avail_semaphores.size(); ++i ) {
+				device.destroy( image_avail_semaphores[ i ] );
+				device.destroy( render_finish_semaphores[ i ] );
+			}
+			for ( size_t i = 0; i < scene_ready_semaphores.size(); ++i ) {
+				device.destroy( scene_ready_semaphores[ i ] );
+				device.destroy( post_ready_semaphores[ i ] );
+			}
+			timeline.destroy();
+			device.destroy( query_pool );
+			// command buffers go with their pools
+			for ( auto &pools : worker_pools ) {
+				for ( auto &pool : pools ) {
+					device.destroy( pool );
+				}
+			}
+			for ( auto &pool : command_pools ) {
+				device.destroy( pool );
+			}
+			for ( auto &pool : compute_pools ) {
+				device.destroy( pool );
+			}
+
+			releaseSwapchain()();
+			device.destroy( swap_chain );
+			device.destroy( render_pass );
+			device.destroy( views_render_pass );
+
+			allocator.destroy();
+			device.destroy();
+		}
+		if ( surface ) {
+			inst.destroySurfaceKHR( surface );
+		}
+		if ( window ) {
+			glfwDestroyWindow( window );
+			glfwTerminate();
+		}
+		inst.destroy();
+	}
+
+	void run()
+	{
+		run_start = chrono::steady_clock::now();
+		while ( !shouldClose() ) {
+			if ( options.resize_every && frame_number && frame_number % options.resize_every == 0 ) {
+				cycleExtent();
+			}
+			drawFrame();
+			++frame_number;
+		}
+		drainCompose();
+
+		device.waitIdle();
+
+		retireFrameRecords();
+		profiler.report();
+		auto memory = allocator.stats();
+		cout << "memory: " << memory.block_count << " device allocations reserving "
+			 << memory.reserved_bytes / double( 1 << 20 ) << " MiB, "
+			 << memory.used_bytes / double( 1 << 20 ) << " MiB in use by "
+			 << memory.allocation_count << " resources, fragmentation "
+			 << memory.fragmentation * 100 << "%" << endl;
+		if ( !recreate_times.empty() ) {
+			auto stall = computePercentiles( recreate_times );
+			cout << "swapchain recreated " << recreate_times.size() << " times, stall ms p50/p95/p99: "
+				 << stall.p50 << " / " << stall.p95 << " / " << stall.p99
+				 << ", pipeline rebuilt " << pipeline_rebuilds << " times" << endl;
+		}
+		if ( options.instance_count > 1 ) {
+			auto update = profiler.stageTimes( ProfileStage::Update, frame_number );
+			cout << "instances: " << options.instance_count << ", cpu update ms p50/p95/p99: "
+				 << update.p50 << " / " << update.p95 << " / " << update.p99 << endl;
+		}
+		if ( options.pipeline_variants > 1 ) {
+			auto pso = pipelines.getStats();
+			cout << "pipelines: " << pso.requests << " requests, " << pso.deduplicated << " deduplicated, "
+				 << pso.compiled << " compiled in " << pso.batches << " batches, "
+				 << pso.failed << " failed, " << pso.fallbacks << " fallback binds" << endl;
+		}
+		if ( options.max_fps > 0 || options.target_latency_ms > 0 || options.low_latency ) {
+			auto pacing = pacer.getStats();
+			cout << "pacing: " << pacing.paced << " frames held back " << pacing.wait_ms << " ms, "
+				 << "input to completion ms p50/p95/p99: " << pacing.latency_ms.p50 << " / "
+				 << pacing.latency_ms.p95 << " / " << pacing.latency_ms.p99 << endl;
+		}
+		if ( !options.capture_path.empty() ) {
+			// the gpu is idle, every pending readback can go to the writer
+			capture.finish();
+			auto stats = capture.getStats();
+			cout << "capture: " << stats.captured << " frames, " << stats.dropped << " dropped, "
+				 << stats.failed << " failed to write, "
+				 << stats.bytes_written / double( 1 << 20 ) << " MiB written, "
+				 << stats.write_ms << " ms per frame on the writer" << endl;
+		}
+		if ( options.stress ) {
+			cout << "stress: " << frame_number << " frames, "
+				 << image_stats.tracked << " image reuses, "
+				 << image_stats.conflicts << " real conflicts waited "
+				 << image_stats.wait_ms << " ms, "
+				 << image_stats.hazards << " of them hazards the slot wait alone would have missed" << endl;
+		}
+		if ( !options.profile_dump.empty() ) {
+			profiler.dump( options.profile_dump );
+		}
+	}
+
+	const Profiler &getProfiler() const { return profiler; }
+	const vector<pair<string, double>> &getStartupPhases() const { return startup_phases; }
+	uint64_t getFrameNumber() const { return frame_number; }
+	const ImageTrackingStats &getImageStats() const { return image_stats; }
+	const vector<double> &getRecreateTimes() const { return recreate_times; }
+	uint32_t getPipelineRebuilds() const { return pipeline_rebuilds; }
+	PipelineStats getPipelineStats() const { return pipelines.getStats(); }
+	CaptureStats getCaptureStats() const { return capture.getStats(); }
+	PacingStats getPacingStats() const { return pacer.getStats(); }
+	MemoryStats getMemoryStats() const
+	{
+		auto stats = allocator.stats();
+		stats.linear_region_bytes = frame_pool.capacity();
+		stats.linear_peak_bytes = frame_pool.peak();
+		return stats;
+	}
+	string getDeviceName() const { return &physical_device.getProperties().deviceName[ 0 ]; }
+	string getPresentModeName() const
+	{
+		return options.headless ? "offscreen" : vk::to_string( present_mode );
+	}
+
+private:
+	bool shouldClose() const
+	{
+		if ( options.frame_count && frame_number >= options.frame_count ) {
+			return true;
+		}
+		if ( options.duration > 0 ) {
+			chrono::duration<double> elapsed = chrono::steady_clock::now() - run_start;
+			if ( elapsed.count() >= options.duration ) {
+				return true;
+			}
+		}
+		return window && glfwWindowShouldClose( window );
+	}
+
+	void initWindow()
+	{
+		glfwInit();
+		glfwWindowHint( GLFW_CLIENT_API, GLFW_NO_API );
+		window = glfwCreateWindow( options.width, options.height, "main", nullptr, nullptr );
+		glfwSetWindowUserPointer( window, this );
+		glfwSetFramebufferSizeCallback( window, []( GLFWwindow *window, int, int ) {
+			auto app = reinterpret_cast<Application *>( glfwGetWindowUserPointer( window ) );
+			app->framebuffer_resized = true;
+		} );
+	}
+	void initVulkan()
+	{
+		timePhase( "instance", [this] {
+			createInstance();
+			setupDebugMessenger();
+		} );
+		if ( !options.headless ) {
+			timePhase( "surface", [this] { createSurface(); } );
+		}
+		timePhase( "device", [this] {
+			pickPhysicalDevice();
+			pipeline_cache_load = loader.load( pipelineCachePath(), LoadPriority::Startup );
+			createLogicalDevice();
+			allocator.init( physical_device, device );
+		} );
+		timePhase( "targets", [this] {
+			if ( options.headless ) {
+				createOffscreenTargets();
+			} else {
+				createSwapchain();
+			}
+			createImageViews();
+			createRenderPass();
+		} );
+		timePhase( "pipeline_cache", [this] { createPipelineCache(); } );
+		timePhase( "pipeline", [this] {
+			pipelines.init( device, pipeline_cache, PIPELINE_THREADS );
+			createGraphicsPipeline();
+			createCullPipeline();
+			createPostPipeline();
+		} );
+		timePhase( "commands", [this] {
+			createFramebuffers();
+			createPostTargets();
+			createCommandPools();
+			createQueryPool();
+			createCommandBuffers();
+			createRecordWorkers();
+			createFramePool();
+			createDescriptors();
+			createInstanceBuffers();
+			createSyncObjects();
+			createCapture();
+			createFrameGraph();
+		} );
+		timePhase( "uploads", [this] {
+			createUploader();
+			createMesh();
+			createCullResources();
+		} );
+	}
+
+	void timePhase( const string &name, const function<void()> &phase )
+	{
+		double ms = 0;
+		{
+			ScopedTimer timer( ms );
+			phase();
+		}
+		startup_phases.emplace_back( name, ms );
+	}
+
+private:
+	void createInstance()
+	{
+		vk::ApplicationInfo appInfo = {};
+		// timeline semaphores are core from 1.2
+		appInfo.apiVersion = VK_API_VERSION_1_2;
+		appInfo.pApplicationName = "...";
+		appInfo.applicationVersion = VK_MAKE_VERSION( 1, 0, 0 );
+		appInfo.pEngineName = "...";
+		appInfo.engineVersion = VK_MAKE_VERSION( 1, 0, 0 );
+
+		vk::InstanceCreateInfo createInfo = {};
+		createInfo.pApplicationInfo = &appInfo;
+
+		auto extensions = getRequiredExtensions();
+		createInfo.enabledExtensionCount = static_cast<uint32_t>( extensions.size() );
+		createInfo.ppEnabledExtensionNames = extensions.data();
+
+		vk::DebugUtilsMessengerCreateInfoEXT debugCreateInfo = {};
+		if ( false ) {
+			//
+		}
+
+		if ( vk::createInstance( &createInfo, nullptr, &inst ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "unable to create instance" );
+		}
+	}
+
+	void setupDebugMessenger()
+	{
+		if ( not false ) return;
+	}
+
+	void createSurface()
+	{
+		VkSurfaceKHR surface;
+		if ( glfwCreateWindowSurface( inst, window, nullptr, &surface ) != VK_SUCCESS ) {
+			throw std::runtime_error( "unable to create window surface" );
+		}
+		this->surface = surface;
+	}
+
+	// the best scoring device that can run this configuration, or the one --device names
+	void pickPhysicalDevice()
+	{
+		DeviceRequirements requirements;
+		// frames are tracked on a timeline semaphore
+		requirements.api_version = VK_API_VERSION_1_2;
+		requirements.timeline_semaphore = true;
+		if ( !options.headless ) {
+			requirements.extensions = device_extensions;
+			requirements.surface = surface;
+		}
+		if ( options.post_mode != PostMode::Off ) {
+			requirements.formats.emplace_back( POST_FORMAT, vk::FormatFeatureFlagBits::eStorageImage );
+		}
+		// views.vs reads gl_ViewIndex, which needs the feature even when the views are drawn one at a time
+		if ( options.views > 1 ) {
+			requirements.multiview_views = multiview() ? options.views : 1;
+		}
+
+		DeviceSelector selector;
+		selector.init( inst, requirements );
+		if ( options.device_bench ) {
+			selector.benchmark();
+		}
+		physical_device = selector.select( options.device, cout ).device;
+	}
+
+	auto findQueueFamilies( const vk::PhysicalDevice &device )
+	{
+		QueueFamilyIndices indices;
+		auto queue_families = device.getQueueFamilyProperties();
+
+		for ( uint32_t idx = 0; idx < queue_families.size(); ++idx ) {
+			auto &queue_family = queue_families[ idx ];
+			if ( !queue_family.queueCount ) {
+				continue;
+			}
+			if ( !indices.graphics_family.has_value() && queue_family.queueFlags & vk::QueueFlagBits::eGraphics ) {
+				indices.graphics_family = idx;
+			}
+			// headless rendering has no surface, so only a graphics queue is needed
+			if ( !options.headless && !indices.present_family.has_value() &&
+				 device.getSurfaceSupportKHR( idx, surface ) ) {
+				indices.present_family = idx;
+			}
+			// usually the copy engine, which runs alongside graphics work
+			if ( !indices.transfer_family.has_value() &&
+				 queue_family.queueFlags & vk::QueueFlagBits::eTransfer &&
+				 !( queue_family.queueFlags & ( vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute ) ) ) {
+				indices.transfer_family = idx;
+			}
+		}
+		if ( !indices.transfer_family.has_value() ) {
+			indices.transfer_family = indices.graphics_family;
+		}
+		// async compute: a queue that runs next to the graphics one
+		for ( uint32_t idx = 0; idx < queue_families.size(); ++idx ) {
+			auto flags = queue_families[ idx ].queueFlags;
+			if ( queue_families[ idx ].queueCount && flags & vk::QueueFlagBits::eCompute &&
+				 !( flags & vk::QueueFlagBits::eGraphics ) ) {
+				indices.compute_family = idx;
+				break;
+			}
+		}
+		if ( !indices.compute_family.has_value() ) {
+			indices.compute_family = indices.graphics_family;
+		}
+		return indices;
+	}
+
+	void createLogicalDevice()
+	{
+		auto indices = findQueueFamilies( physical_device );
+
+		vector<vk::DeviceQueueCreateInfo> queue_create_infos;
+		set<uint32_t> unique_queue_families = {
+			indices.graphics_family.value(),
+			indices.transfer_family.value(),
+			indices.compute_family.value()
+		};
+		if ( indices.present_family.has_value() ) {
+			unique_queue_families.insert( indices.present_family.value() );
+		}
+
+		float queue_priority = 1.f;
+		for ( auto queue_family : unique_queue_families ) {
+			auto queue_create_info =
+			  vk::DeviceQueueCreateInfo()
+				.setQueueFamilyIndex( queue_family )
+				.setQueueCount( 1 )
+				.setPQueuePriorities( &queue_priority );
+			queue_create_infos.emplace_back( queue_create_info );
+		}
+
+		auto device_features = vk::PhysicalDeviceFeatures();
+		auto vulkan11_features =
+		  vk::PhysicalDeviceVulkan11Features()
+			.setMultiview( options.views > 1 );
+		auto vulkan12_features =
+		  vk::PhysicalDeviceVulkan12Features()
+			.setPNext( &vulkan11_features )
+			.setTimelineSemaphore( true );
+
+		vector<const char *> extensions;
+		if ( !options.headless ) {
+			extensions = device_extensions;
+		}
+
+		auto create_info =
+		  vk::DeviceCreateInfo()
+			.setPNext( &vulkan12_features )
+			.setQueueCreateInfoCount( queue_create_infos.size() )
+			.setPQueueCreateInfos( queue_create_infos.data() )
+			.setPEnabledFeatures( &device_features )
+			.setEnabledExtensionCount( extensions.size() )
+			.setPpEnabledExtensionNames( extensions.data() );
+
+		if ( false ) {
+			// ...
+		}
+
+		if ( physical_device.createDevice( &create_info, nullptr, &device ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to create logical device" );
+		}
+
+		graphics_queue = device.getQueue( indices.graphics_family.value(), 0 );
+		transfer_queue = device.getQueue( indices.transfer_family.value(), 0 );
+		compute_queue = device.getQueue( indices.compute_family.value(), 0 );
+		if ( indices.present_family.has_value() ) {
+			present_queue = device.getQueue( indices.present_family.value(), 0 );
+		}
+	}
+
+	void createOffscreenTargets()
+	{
+		swap_chain_image_format = vk::Format::eR8G8B8A8Unorm;
+		swap_chain_extent = vk::Extent2D{ options.width, options.height };
+
+		// like a swapchain, keep one spare image beyond the frames in flight
+		auto image_cnt = options.swapchain_images ? options.swapchain_images : options.frames_in_flight + 1;
+		swap_chain_images.resize( image_cnt );
+		offscreen_allocations.resize( image_cnt );
+		for ( size_t i = 0; i < swap_chain_images.size(); ++i ) {
+			auto image_info =
+			  vk::ImageCreateInfo()
+				.setImageType( vk::ImageType::e2D )
+				.setFormat( swap_chain_image_format )
+				.setExtent( vk::Extent3D{ swap_chain_extent.width, swap_chain_extent.height, 1 } )
+				.setMipLevels( 1 )
+				.setArrayLayers( 1 )
+				.setSamples( vk::SampleCountFlagBits::e1 )
+				.setTiling( vk::ImageTiling::eOptimal )
+				.setUsage( vk::ImageUsageFlagBits::eColorAttachment |
+						   vk::ImageUsageFlagBits::eTransferSrc |
+						   vk::ImageUsageFlagBits::eTransferDst )
+				.setSharingMode( vk::SharingMode::eExclusive )
+				.setInitialLayout( vk::ImageLayout::eUndefined );
+
+			if ( device.createImage( &image_info, nullptr, &swap_chain_images[ i ] ) != vk::Result::eSuccess ) {
+				throw std::runtime_error( "failed to create offscreen image" );
+			}
+
+			offscreen_allocations[ i ] = allocator.allocateImage( swap_chain_images[ i ],
+																  vk::MemoryPropertyFlagBits::eDeviceLocal );
+		}
+	}
+
+	void createSwapchain()
+	{
+		auto swap_chain_support = querySwapchainSupport( physical_device );
+
+		auto surface_format = chooseSwapSurfaceFormat( swap_chain_support.formats );
+		present_mode = chooseSwapPresentMode( swap_chain_support.present_modes );
+		auto extent = chooseSwapExtent( swap_chain_support.capabilities );
+		// handing the old swapchain over lets the driver reuse its images
+		auto old_swap_chain = swap_chain;
+
+		uint32_t image_cnt = options.swapchain_images ? options.swapchain_images
+													  : swap_chain_support.capabilities.minImageCount + 1;
+		image_cnt = std::max( image_cnt, swap_chain_support.capabilities.minImageCount );
+		if ( swap_chain_support.capabilities.maxImageCount > 0 && image_cnt > swap_chain_support.capabilities.maxImageCount ) {
+			image_cnt = swap_chain_support.capabilities.maxImageCount;
+		}
+
+		auto create_info =
+		  vk::SwapchainCreateInfoKHR()
+			.setSurface( surface )
+			.setMinImageCount( image_cnt )
+			.setImageFormat( surface_format.format )
+			.setImageColorSpace( surface_format.colorSpace )
+			.setImageExtent( extent )
+			.setImageArrayLayers( 1 )
+			.setImageUsage( vk::ImageUsageFlagBits::eColorAttachment );
+
+		// captured frames are copied out of the swapchain image
+		if ( !options.capture_path.empty() ) {
+			if ( !( swap_chain_support.capabilities.supportedUsageFlags & vk::ImageUsageFlagBits::eTransferSrc ) ) {
+				throw std::runtime_error( "surface images cannot be copied from, capture is unsupported" );
+			}
+			create_info.imageUsage |= vk::ImageUsageFlagBits::eTransferSrc;
+		}
+		// post processed frames and tiled views are blitted in
+		if ( options.post_mode != PostMode::Off || options.views > 1 ) {
+			if ( !( swap_chain_support.capabilities.supportedUsageFlags & vk::ImageUsageFlagBits::eTransferDst ) ) {
+				throw std::runtime_error( "surface images cannot be blitted to, post processing and views are unsupported" );
+			}
+			create_info.imageUsage |= vk::ImageUsageFlagBits::eTransferDst;
+		}
+
+		auto indices = findQueueFamilies( physical_device );
+		uint32_t queue_family_indices[] = {
+			indices.graphics_family.value(),
+			indices.present_family.value()
+		};
+
+		if ( indices.graphics_family != indices.present_family ) {
+			create_info.setImageSharingMode( vk::SharingMode::eConcurrent )
+			  .setQueueFamilyIndexCount( 2 )
+			  .setPQueueFamilyIndices( queue_family_indices );
+		} else {
+			create_info.setImageSharingMode( vk::SharingMode::eExclusive );
+		}
+
+		create_info.setPreTransform( swap_chain_support.capabilities.currentTransform )
+		  .setCompositeAlpha( vk::CompositeAlphaFlagBitsKHR::eOpaque )
+		  .setPresentMode( present_mode )
+		  .setClipped( true )
+		  .setOldSwapchain( old_swap_chain );
+
+		if ( device.createSwapchainKHR( &create_info, nullptr, &swap_chain ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to create swap chain" );
+		}
+		if ( old_swap_chain ) {
+			// the one thing recreation waits for: the frames still rendering to the old images
+			if ( !image_frames.empty() ) {
+				timeline.wait( *max_element( image_frames.begin(), image_frames.end() ) );
+			}
+			device.destroy( old_swap_chain );
+		}
+
+		swap_chain_images = device.getSwapchainImagesKHR( swap_chain );
+
+		swap_chain_image_format = surface_format.format;
+		swap_chain_extent = extent;
+	}
+
+	/* rebuilds only what depends on the swapchain images or extent; the
+	   device, render pass and pipeline stay alive unless the surface
+	   format they were built against changed */
+	void recreateSwapchain()
+	{
+		// the held back frame is the newest one, and still composes into the old images
+		drainCompose();
+		// a minimized window has nothing to render to
+		if ( window ) {
+			int width = 0, height = 0;
+			glfwGetFramebufferSize( window, &width, &height );
+			while ( ( width == 0 || height == 0 ) && !glfwWindowShouldClose( window ) ) {
+				glfwWaitEvents();
+				glfwGetFramebufferSize( window, &width, &height );
+			}
+		}
+		framebuffer_resized = false;
+
+		double stall_ms = 0;
+		{
+			ScopedTimer timer( stall_ms );
+
+			auto old_format = swap_chain_image_format;
+			auto old_pipeline = graphics_pipeline;
+			// the frames in flight keep what they were recorded with until they retire
+			retireBehindNewest( releaseSwapchain() );
+
+			if ( options.headless ) {
+				createOffscreenTargets();
+			} else {
+				createSwapchain();
+			}
+			createImageViews();
+
+			// the pipeline only depends on the render pass, never on the extent
+			if ( swap_chain_image_format != old_format ) {
+				// every pipeline names the old render pass
+				retireBehindNewest( [this, old_pipelines = pipelines.release(), old_render_pass = render_pass,
+									  old_views_render_pass = views_render_pass] {
+					for ( auto &pipeline : old_pipelines ) {
+						device.destroy( pipeline );
+					}
+					device.destroy( old_render_pass );
+					device.destroy( old_views_render_pass );
+				} );
+				views_render_pass = nullptr;
+				createRenderPass();
+				createGraphicsPipeline();
+				// the graph's color images are drawn through that render pass as well
+				if ( options.post_mode == PostMode::Serial ) {
+					frame_graph.setFormat( graph_scene, swap_chain_image_format );
+				}
+				if ( options.views > 1 ) {
+					frame_graph.setFormat( graph_views, swap_chain_image_format );
+				}
+			}
+
+			createFramebuffers();
+			createPostTargets();
+			// transients follow the extent, the old ones were released above
+			frame_graph.compile( device, allocator, swap_chain_extent );
+			if ( options.post_mode == PostMode::Async ) {
+				compose_graph.compile( device, allocator, swap_chain_extent );
+			}
+			createGraphTargets();
+
+			image_frames.assign( swap_chain_images.size(), 0 );
+		}
+		recreate_times.emplace_back( stall_ms );
+		if ( graphics_pipeline != old_pipeline ) {
+			++pipeline_rebuilds;
+		}
+		cout << "swapchain recreated at " << swap_chain_extent.width << "x" << swap_chain_extent.height
+			 << " in " << stall_ms << " ms" << endl;
+	}
+
+	/* everything built on the swapchain images or extent but the swapchain
+	   itself, handed over to the returned function: recreation retires it
+	   behind the frames still using it, teardown runs it at once */
+	function<void()> releaseSwapchain()
+	{
+		auto release = [this, old_scene_targets = std::move( scene_targets ),
+						old_view_frame_buffers = std::move( view_frame_buffers ), old_view_layers = std::move( view_layers ),
+						old_scene_frame_buffer = scene_frame_buffer,
+						old_frame_buffers = std::move( swap_chain_frame_buffers ),
+						old_image_views = std::move( swap_chain_image_views ),
+						// swapchain images belong to the swapchain, offscreen ones to us
+						old_offscreen_images = options.headless ? swap_chain_images : vector<vk::Image>{},
+						old_offscreen_allocations = std::move( offscreen_allocations ),
+						frame_transients = frame_graph.releaseTransients(),
+						compose_transients = compose_graph.releaseTransients()] {
+			for ( auto &target : old_scene_targets ) {
+				device.destroy( target.frame_buffer );
+				device.destroy( target.scene_view );
+				device.destroy( target.scene );
+				allocator.free( target.scene_allocation );
+				device.destroy( target.post_view );
+				device.destroy( target.post );
+				allocator.free( target.post_allocation );
+			}
+			// the framebuffers and layer views over the transients go before them
+			for ( auto &frame_buffer : old_view_frame_buffers ) {
+				device.destroy( frame_buffer );
+			}
+			for ( auto &view : old_view_layers ) {
+				device.destroy( view );
+			}
+			device.destroy( old_scene_frame_buffer );
+			frame_transients();
+			compose_transients();
+			for ( auto &frame_buffer : old_frame_buffers ) {
+				device.destroy( frame_buffer );
+			}
+			for ( auto &image_view : old_image_views ) {
+				device.destroy( image_view );
+			}
+			for ( size_t i = 0; i < old_offscreen_images.size(); ++i ) {
+				device.destroy( old_offscreen_images[ i ] );
+				allocator.free( old_offscreen_allocations[ i ] );
+			}
+		};
+		scene_targets.clear();
+		view_frame_buffers.clear();
+		view_layers.clear();
+		scene_frame_buffer = nullptr;
+		swap_chain_frame_buffers.clear();
+		swap_chain_image_views.clear();
+		offscreen_allocations.clear();
+		return release;
+	}
+
+	// alternates between the configured extent and half of it
+	void cycleExtent()
+	{
+		resize_toggle = !resize_toggle;
+		auto width = resize_toggle ? std::max( base_extent.width / 2, 1u ) : base_extent.width;
+		auto height = resize_toggle ? std::max( base_extent.height / 2, 1u ) : base_extent.height;
+		if ( window ) {
+			glfwSetWindowSize( window, width, height );
+		} else {
+			options.width = width;
+			options.height = height;
+		}
+		framebuffer_resized = true;
+	}
+
+	void createImageViews()
+	{
+		swap_chain_image_views.resize( swap_chain_images.size() );
+		for ( size_t i = 0; i < swap_chain_images.size(); ++i ) {
+			auto create_info =
+			  vk::ImageViewCreateInfo()
+				.setImage( swap_chain_images[ i ] )
+				.setViewType( vk::ImageViewType::e2D )
+				.setFormat( swap_chain_image_format )
+				.setComponents( { vk::ComponentSwizzle::eIdentity,
+								  vk::ComponentSwizzle::eIdentity,
+								  vk::ComponentSwizzle::eIdentity,
+								  vk::ComponentSwizzle::eIdentity } );
+			create_info.subresourceRange
+			  .setAspectMask( vk::ImageAspectFlagBits::eColor )
+			  .setBaseMipLevel( 0 )
+			  .setLevelCount( 1 )
+			  .setBaseArrayLayer( 0 )
+			  .setLayerCount( 1 );
+
+			if ( device.createImageView( &create_info, nullptr, &swap_chain_image_views[ i ] ) != vk::Result::eSuccess ) {
+				throw std::runtime_error( "failed to create image views" );
+			}
+		}
+	}
+
+	void createRenderPass()
+	{
+		render_pass = buildRenderPass( 0 );
+		if ( multiview() ) {
+			views_render_pass = buildRenderPass( ( 1u << options.views ) - 1 );
+		}
+	}
+
+	/* a single color attachment the frame graph transitions around the pass;
+	   with a view mask every subpass draw is broadcast to the masked layers */
+	vk::RenderPass buildRenderPass( uint32_t view_mask )
+	{
+		auto color_attachment =
+		  vk::AttachmentDescription()
+			.setFormat( swap_chain_image_format )
+			.setSamples( vk::SampleCountFlagBits::e1 )
+			.setLoadOp( vk::AttachmentLoadOp::eClear )
+			.setStoreOp( vk::AttachmentStoreOp::eStore )
+			.setStencilLoadOp( vk::AttachmentLoadOp::eDontCare )
+			.setStencilStoreOp( vk::AttachmentStoreOp::eDontCare )
+			// the frame graph transitions the target around the pass
+			.setInitialLayout( vk::ImageLayout::eColorAttachmentOptimal )
+			.setFinalLayout( vk::ImageLayout::eColorAttachmentOptimal );
+
+		auto color_attachment_ref =
+		  vk::AttachmentReference()
+			.setAttachment( 0 )
+			.setLayout( vk::ImageLayout::eColorAttachmentOptimal );
+
+		auto subpass =
+		  vk::SubpassDescription()
+			.setPipelineBindPoint( vk::PipelineBindPoint::eGraphics )
+			.setColorAttachmentCount( 1 )
+			.setPColorAttachments( &color_attachment_ref );
+
+		// the views of one pass are drawn in parallel, so they are correlated for the implementation's benefit
+		auto multiview_info =
+		  vk::RenderPassMultiviewCreateInfo()
+			.setSubpassCount( 1 )
+			.setPViewMasks( &view_mask )
+			.setCorrelationMaskCount( 1 )
+			.setPCorrelationMasks( &view_mask );
+
+		auto render_pass_info =
+		  vk::RenderPassCreateInfo()
+			.setPNext( view_mask ? &multiview_info : nullptr )
+			.setAttachmentCount( 1 )
+			.setPAttachments( &color_attachment )
+			.setSubpassCount( 1 )
+			.setPSubpasses( &subpass );
+
+		vk::RenderPass pass;
+		if ( device.createRenderPass( &render_pass_info, nullptr, &pass ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to create render pass" );
+		}
+		return pass;
+	}
+
+	// what the mesh is drawn with: the multiview pass if there is one
+	vk::RenderPass mainRenderPass() const
+	{
+		return views_render_pass ? views_render_pass : render_pass;
+	}
+
+	bool multiview() const
+	{
+		return options.views > 1 && options.view_mode == ViewMode::Multiview;
+	}
+
+	const char *vertexShader() const
+	{
+		return options.views > 1 ? VIEWS_SHADER : VERT_SHADER;
+	}
+
+	// the pipeline the mesh is drawn with, variants only change its constants
+	GraphicsPipelineDesc basePipelineDesc()
+	{
+		return basePipelineDesc( vert_shader_load, frag_shader_load );
+	}
+
+	// the same from other shaders, a reload's before they replace the current ones
+	GraphicsPipelineDesc basePipelineDesc( const shared_ptr<AssetLoad> &vert, const shared_ptr<AssetLoad> &frag )
+	{
+		GraphicsPipelineDesc desc;
+		// the mappings stay alive, so a rebuild after a format change reads no files
+		auto &vert_load = loader.wait( vert );
+		desc.vertex_shader = vert_load.file;
+		auto &frag_load = loader.wait( frag );
+		desc.fragment_shader = frag_load.file;
+		if ( !desc.vertex_shader ) {
+			throw std::runtime_error( vert_load.error );
+		}
+		if ( !desc.fragment_shader ) {
+			throw std::runtime_error( frag_load.error );
+		}
+
+		// binding 0 steps per vertex through the mesh, binding 1 per instance
+		desc.bindings = { Vertex::bindingDescription(), InstanceData::bindingDescription() };
+		desc.attributes = Vertex::attributeDescriptions();
+		for ( auto &attribute : InstanceData::attributeDescriptions() ) {
+			desc.attributes.emplace_back( attribute );
+		}
+		// the TINT specialization constant of main.fs
+		desc.fragment_constants = { 1.f };
+		desc.layout = pipeline_layout;
+		desc.render_pass = mainRenderPass();
+		return desc;
+	}
+
+	/* the base pipeline is built right here since nothing can be drawn
+	   without it; the variants are only queued and stand in for by the base
+	   pipeline until their compile lands */
+	void createGraphicsPipeline()
+	{
+		if ( !pipeline_layout ) {
+			// the frame's uniforms, read through a dynamic offset into the uniform ring
+			auto frame_binding =
+			  vk::DescriptorSetLayoutBinding()
+				.setBinding( 0 )
+				.setDescriptorType( vk::DescriptorType::eUniformBufferDynamic )
+				.setDescriptorCount( 1 )
+				.setStageFlags( vk::ShaderStageFlagBits::eVertex );
+
+			auto set_layout_info =
+			  vk::DescriptorSetLayoutCreateInfo()
+				.setBindingCount( 1 )
+				.setPBindings( &frame_binding );
+
+			if ( device.createDescriptorSetLayout( &set_layout_info, nullptr, &frame_set_layout ) != vk::Result::eSuccess ) {
+				throw std::runtime_error( "failed to create frame descriptor set layout" );
+			}
+			vector<vk::DescriptorSetLayout> set_layouts = { frame_set_layout };
+			// the view matrices, another dynamic offset into the same ring
+			if ( options.views > 1 ) {
+				if ( device.createDescriptorSetLayout( &set_layout_info, nullptr, &view_set_layout ) != vk::Result::eSuccess ) {
+					throw std::runtime_error( "failed to create view descriptor set layout" );
+				}
+				set_layouts.emplace_back( view_set_layout );
+			}
+
+			auto push_constant_range =
+			  vk::PushConstantRange()
+				.setStageFlags( vk::ShaderStageFlagBits::eVertex )
+				.setOffset( 0 )
+				.setSize( sizeof( DrawConstants ) );
+
+			auto pipeline_layout_info =
+			  vk::PipelineLayoutCreateInfo()
+				.setSetLayoutCount( set_layouts.size() )
+				.setPSetLayouts( set_layouts.data() )
+				.setPushConstantRangeCount( 1 )
+				.setPPushConstantRanges( &push_constant_range );
+
+			if ( device.createPipelineLayout( &pipeline_layout_info, nullptr, &pipeline_layout ) != vk::Result::eSuccess ) {
+				throw std::runtime_error( "failed to create pipeline layout" );
+			}
+		}
+
+		auto desc = basePipelineDesc();
+		auto compile_start = chrono::steady_clock::now();
+		graphics_pipeline = pipelines.compile( desc );
+		base_pipeline = desc.hash();
+		chrono::duration<double, milli> compile_time = chrono::steady_clock::now() - compile_start;
+		cout << "pipeline cache " << ( pipeline_cache_hit ? "hit" : "miss" )
+			 << ": graphics pipeline compiled in " << compile_time.count() << " ms" << endl;
+
+		pipeline_variants = submitPipelineVariants( desc );
+		// whatever a reload had queued went with the old pipelines
+		reload_base = 0;
+		reload_variants.clear();
+		reload_vert.reset();
+		reload_frag.reset();
+	}
+
+	// variant i tints the mesh, variant 0 is the base pipeline itself
+	vector<uint64_t> submitPipelineVariants( GraphicsPipelineDesc desc )
+	{
+		vector<uint64_t> keys;
+		for ( uint32_t i = 0; i < options.pipeline_variants; ++i ) {
+			desc.fragment_constants = { 1.f - .5f * i / options.pipeline_variants };
+			keys.emplace_back( pipelines.submit( desc ) );
+		}
+		return keys;
+	}
+
+	/* compute pipeline for gpu culling: reads the object buffer, appends the
+	   visible instances to the slot's instance buffer and counts them into the
+	   instanceCount of the slot's indirect draw */
+	void createCullPipeline()
+	{
+		if ( options.cull_mode != CullMode::Gpu ) {
+			return;
+		}
+
+		vk::DescriptorSetLayoutBinding bindings[ 3 ];
+		for ( uint32_t i = 0; i < 3; ++i ) {
+			bindings[ i ]
+			  .setBinding( i )
+			  .setDescriptorType( vk::DescriptorType::eStorageBuffer )
+			  .setDescriptorCount( 1 )
+			  .setStageFlags( vk::ShaderStageFlagBits::eCompute );
+		}
+
+		auto set_layout_info =
+		  vk::DescriptorSetLayoutCreateInfo()
+			.setBindingCount( 3 )
+			.setPBindings( bindings );
+
+		if ( device.createDescriptorSetLayout( &set_layout_info, nullptr, &cull_set_layout ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to create culling descriptor set layout" );
+		}
+
+		auto push_constant_range =
+		  vk::PushConstantRange()
+			.setStageFlags( vk::ShaderStageFlagBits::eCompute )
+			.setOffset( 0 )
+			.setSize( sizeof( CullView ) );
+
+		auto pipeline_layout_info =
+		  vk::PipelineLayoutCreateInfo()
+			.setSetLayoutCount( 1 )
+			.setPSetLayouts( &cull_set_layout )
+			.setPushConstantRangeCount( 1 )
+			.setPPushConstantRanges( &push_constant_range );
+
+		if ( device.createPipelineLayout( &pipeline_layout_info, nullptr, &cull_pipeline_layout ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to create culling pipeline layout" );
+		}
+
+		cull_pipeline = buildComputePipeline( cull_shader_load, cull_pipeline_layout );
+	}
+
+	/* blur and tonemap: samples the slot's scene image and writes the slot's
+	   post image, which is then blitted to the target */
+	void createPostPipeline()
+	{
+		if ( options.post_mode == PostMode::Off ) {
+			return;
+		}
+
+		vk::DescriptorSetLayoutBinding bindings[ 2 ];
+		bindings[ 0 ]
+		  .setBinding( 0 )
+		  .setDescriptorType( vk::DescriptorType::eCombinedImageSampler )
+		  .setDescriptorCount( 1 )
+		  .setStageFlags( vk::ShaderStageFlagBits::eCompute );
+		bindings[ 1 ]
+		  .setBinding( 1 )
+		  .setDescriptorType( vk::DescriptorType::eStorageImage )
+		  .setDescriptorCount( 1 )
+		  .setStageFlags( vk::ShaderStageFlagBits::eCompute );
+
+		auto set_layout_info =
+		  vk::DescriptorSetLayoutCreateInfo()
+			.setBindingCount( 2 )
+			.setPBindings( bindings );
+
+		if ( device.createDescriptorSetLayout( &set_layout_info, nullptr, &post_set_layout ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to create post processing descriptor set layout" );
+		}
+
+		auto push_constant_range =
+		  vk::PushConstantRange()
+			.setStageFlags( vk::ShaderStageFlagBits::eCompute )
+			.setOffset( 0 )
+			.setSize( sizeof( PostConstants ) );
+
+		auto pipeline_layout_info =
+		  vk::PipelineLayoutCreateInfo()
+			.setSetLayoutCount( 1 )
+			.setPSetLayouts( &post_set_layout )
+			.setPushConstantRangeCount( 1 )
+			.setPPushConstantRanges( &push_constant_range );
+
+		if ( device.createPipelineLayout( &pipeline_layout_info, nullptr, &post_pipeline_layout ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to create post processing pipeline layout" );
+		}
+
+		auto sampler_info =
+		  vk::SamplerCreateInfo()
+			.setMagFilter( vk::Filter::eLinear )
+			.setMinFilter( vk::Filter::eLinear )
+			.setMipmapMode( vk::SamplerMipmapMode::eNearest )
+			.setAddressModeU( vk::SamplerAddressMode::eClampToEdge )
+			.setAddressModeV( vk::SamplerAddressMode::eClampToEdge )
+			.setAddressModeW( vk::SamplerAddressMode::eClampToEdge )
+			.setMaxLod( 0.f );
+
+		if ( device.createSampler( &sampler_info, nullptr, &post_sampler ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to create post processing sampler" );
+		}
+
+		post_pipeline = buildComputePipeline( post_shader_load, post_pipeline_layout );
+	}
+
+	vk::Pipeline buildComputePipeline( const shared_ptr<AssetLoad> &shader_load, vk::PipelineLayout layout )
+	{
+		vk::ShaderModule shader_module = createShaderModule( loader.wait( shader_load ) );
+
+		auto stage_info =
+		  vk::PipelineShaderStageCreateInfo()
+			.setStage( vk::ShaderStageFlagBits::eCompute )
+			.setModule( shader_module )
+			.setPName( "main" );
+
+		auto pipeline_info =
+		  vk::ComputePipelineCreateInfo()
+			.setStage( stage_info )
+			.setLayout( layout );
+
+		vk::Pipeline pipeline;
+		auto result = device.createComputePipelines( pipeline_cache, 1, &pipeline_info, nullptr, &pipeline );
+		device.destroy( shader_module );
+		if ( result != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to create compute pipeline" );
+		}
+		return pipeline;
+	}
+
+	/* maps the shaders written since the last frame and rebuilds only the
+	   pipelines built from each; a shader replaces its load only once they
+	   built, so a broken one never reaches later rebuilds of other stages */
+	void reloadShaders()
+	{
+		for ( auto &name : shader_watcher->poll() ) {
+			shared_ptr<AssetLoad> *current = nullptr;
+			if ( name == vertexShader() ) {
+				current = &vert_shader_load;
+			} else if ( name == FRAG_SHADER ) {
+				current = &frag_shader_load;
+			} else if ( name == CULL_SHADER && options.cull_mode == CullMode::Gpu ) {
+				current = &cull_shader_load;
+			} else if ( name == POST_SHADER && options.post_mode != PostMode::Off ) {
+				current = &post_shader_load;
+			} else {
+				continue;
+			}
+			// a newer write supersedes a reload still in progress
+			auto &pending = shader_reloads[ name ];
+			if ( pending ) {
+				pending->cancel();
+			}
+			pending = loader.load( name, LoadPriority::Streaming, [this, name, current]( AssetLoad &load ) {
+				auto reload = std::move( shader_reloads[ name ] );
+				if ( !load.file ) {
+					cerr << "shader reload failed: " << load.error << endl;
+					return;
+				}
+				try {
+					if ( current == &cull_shader_load ) {
+						reloadCullPipeline( reload );
+					} else if ( current == &post_shader_load ) {
+						reloadPostPipeline( reload );
+					} else {
+						// swapped in by promoteReload along with the pipelines
+						reloadGraphicsPipelines( current, std::move( reload ) );
+						return;
+					}
+					*current = std::move( reload );
+					cout << "reloaded " << name << " at frame " << frame_number << endl;
+				} catch ( const std::exception &e ) {
+					cerr << "shader reload failed: " << e.what() << endl;
+				}
+			} );
+		}
+	}
+
+	/* queued like any other variant: frames keep drawing with the current
+	   pipelines until the new ones are compiled, see promoteReload */
+	void reloadGraphicsPipelines( shared_ptr<AssetLoad> *current, shared_ptr<AssetLoad> load )
+	{
+		// on top of the other stage's reload if that is still compiling
+		( current == &vert_shader_load ? reload_vert : reload_frag ) = std::move( load );
+		auto desc = basePipelineDesc( reload_vert ? reload_vert : vert_shader_load,
+									  reload_frag ? reload_frag : frag_shader_load );
+		// a reload still compiling is superseded
+		releasePipelines( reload_base, reload_variants );
+		reload_base = pipelines.submit( desc );
+		reload_variants = submitPipelineVariants( desc );
+	}
+
+	/* swaps a reload in once none of it is compiling anymore, if its base
+	   pipeline built; if not the current pipelines stay. Either way the set
+	   that lost is released, so reloads do not pile up in the manager. A
+	   variant that failed on its own draws with the base pipeline */
+	void promoteReload()
+	{
+		if ( !reload_base || pipelines.state( reload_base ) == PipelineState::Pending ) {
+			return;
+		}
+		for ( auto key : reload_variants ) {
+			if ( pipelines.state( key ) == PipelineState::Pending ) {
+				return;
+			}
+		}
+		if ( pipelines.state( reload_base ) == PipelineState::Ready ) {
+			if ( reload_vert ) {
+				vert_shader_load = std::move( reload_vert );
+			}
+			if ( reload_frag ) {
+				frag_shader_load = std::move( reload_frag );
+			}
+			swap( base_pipeline, reload_base );
+			swap( pipeline_variants, reload_variants );
+			for ( auto &key : pipeline_variants ) {
+				if ( pipelines.state( key ) == PipelineState::Failed ) {
+					key = base_pipeline;
+				}
+			}
+			cout << "reloaded graphics pipelines at frame " << frame_number << endl;
+		} else {
+			cerr << "graphics pipeline reload failed, keeping the current pipelines" << endl;
+		}
+		releasePipelines( reload_base, reload_variants );
+		reload_base = 0;
+		reload_variants.clear();
+		reload_vert.reset();
+		reload_frag.reset();
+	}
+
+	// forgets keys not drawn with anymore, their pipelines go once the frames recorded with them retired
+	void releasePipelines( uint64_t base, const vector<uint64_t> &variants )
+	{
+		auto keys = variants;
+		keys.emplace_back( base );
+		for ( auto key : keys ) {
+			if ( key == base_pipeline || find( pipeline_variants.begin(), pipeline_variants.end(), key ) != pipeline_variants.end() ) {
+				continue;
+			}
+			// a key repeated in the list is gone the second time
+			if ( auto pipeline = pipelines.remove( key ) ) {
+				retire( [this, pipeline] { device.destroy( pipeline ); } );
+			}
+		}
+	}
+
+	// swapped right away, the old one goes once the frames recorded with it retired
+	void reloadCullPipeline( const shared_ptr<AssetLoad> &load )
+	{
+		auto old_pipeline = cull_pipeline;
+		cull_pipeline = buildComputePipeline( load, cull_pipeline_layout );
+		retire( [this, old_pipeline] { device.destroy( old_pipeline ); } );
+	}
+
+	void reloadPostPipeline( const shared_ptr<AssetLoad> &load )
+	{
+		auto old_pipeline = post_pipeline;
+		post_pipeline = buildComputePipeline( load, post_pipeline_layout );
+		retire( [this, old_pipeline] { device.destroy( old_pipeline ); } );
+	}
+
+	void createPipelineCache()
+	{
+		auto load_start = chrono::steady_clock::now();
+
+		// a missing file simply fails to load, which is a cold start
+		auto &load = loader.wait( pipeline_cache_load );
+		const char *data = nullptr;
+		size_t size = 0;
+		if ( load.file ) {
+			data = load.file->data();
+			size = load.file->size();
+		}
+		// a stale or foreign blob is dropped rather than handed to the driver
+		pipeline_cache_hit = isPipelineCacheCompatible( data, size );
+		if ( !pipeline_cache_hit ) {
+			size = 0;
+		}
+
+		auto cache_info =
+		  vk::PipelineCacheCreateInfo()
+			.setInitialDataSize( size )
+			.setPInitialData( data );
+
+		if ( device.createPipelineCache( &cache_info, nullptr, &pipeline_cache ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to create pipeline cache" );
+		}
+
+		chrono::duration<double, milli> load_time = chrono::steady_clock::now() - load_start;
+		cout << "pipeline cache " << ( pipeline_cache_hit ? "loaded " : "empty " )
+			 << size << " bytes in " << load_time.count() << " ms" << endl;
+		// the driver copied what it needed
+		pipeline_cache_load.reset();
+	}
+
+	bool isPipelineCacheCompatible( const char *data, size_t size )
+	{
+		struct
+		{
+			uint32_t header_size;
+			uint32_t header_version;
+			uint32_t vendor_id;
+			uint32_t device_id;
+			uint8_t uuid[ VK_UUID_SIZE ];
+		} header;
+
+		if ( size < sizeof( header ) ) {
+			return false;
+		}
+		memcpy( &header, data, sizeof( header ) );
+
+		auto properties = physical_device.getProperties();
+		return header.header_size >= sizeof( header ) &&
+			   header.header_version == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+			   header.vendor_id == properties.vendorID &&
+			   header.device_id == properties.deviceID &&
+			   !memcmp( header.uuid, &properties.pipelineCacheUUID[ 0 ], VK_UUID_SIZE );
+	}
+
+	void savePipelineCache()
+	{
+		if ( !pipeline_cache ) {
+			return;
+		}
+		auto data = device.getPipelineCacheData( pipeline_cache );
+
+		// write beside the target and rename, so a crash never leaves a torn cache
+		auto path = pipelineCachePath();
+		auto tmp_path = path + ".tmp";
+		{
+			ofstream os( tmp_path, ios::binary | ios::trunc );
+			if ( !os.is_open() ) {
+				cerr << "failed to save pipeline cache" << endl;
+				return;
+			}
+			os.write( reinterpret_cast<const char *>( data.data() ), data.size() );
+			if ( !os.good() ) {
+				cerr << "failed to save pipeline cache" << endl;
+				return;
+			}
+		}
+		if ( rename( tmp_path.c_str(), path.c_str() ) != 0 ) {
+			cerr << "failed to save pipeline cache" << endl;
+			remove( tmp_path.c_str() );
+			return;
+		}
+		cout << "pipeline cache saved " << data.size() << " bytes" << endl;
+	}
+
+	string pipelineCachePath()
+	{
+		auto properties = physical_device.getProperties();
+		ostringstream os;
+		os << "pipeline_cache_" << hex << setfill( '0' )
+		   << setw( 8 ) << properties.vendorID << "_"
+		   << setw( 8 ) << properties.deviceID << "_";
+		for ( uint32_t i = 0; i < VK_UUID_SIZE; ++i ) {
+			os << setw( 2 ) << static_cast<uint32_t>( properties.pipelineCacheUUID[ i ] );
+		}
+		os << ".bin";
+		return os.str();
+	}
+
+	void createFramebuffers()
+	{
+		swap_chain_frame_buffers.resize( swap_chain_image_views.size() );
+		for ( size_t i = 0; i < swap_chain_frame_buffers.size(); ++i ) {
+			vk::ImageView attachments[] = { swap_chain_image_views[ i ] };
+
+			auto frame_buffer_info =
+			  vk::FramebufferCreateInfo()
+				.setRenderPass( render_pass )
+				.setAttachmentCount( 1 )
+				.setPAttachments( attachments )
+				.setWidth( swap_chain_extent.width )
+				.setHeight( swap_chain_extent.height )
+				.setLayers( 1 );
+
+			if ( device.createFramebuffer( &frame_buffer_info, nullptr,
+										   &swap_chain_frame_buffers[ i ] ) != vk::Result::eSuccess ) {
+				throw std::runtime_error( "failed to create framebuffer" );
+			}
+		}
+	}
+
+	/* async post processing only, per frame slot: the scene the mesh is
+	   drawn into and the post processed result. Slots never share them, so
+	   the compute queue can still be reading one frame's scene while the next
+	   frame draws into its own, which a graph transient could not allow. With
+	   a separate compute family both queues use them without ownership
+	   transfers */
+	void createPostTargets()
+	{
+		if ( options.post_mode != PostMode::Async ) {
+			return;
+		}
+		auto indices = findQueueFamilies( physical_device );
+		auto concurrent = indices.graphics_family != indices.compute_family;
+
+		scene_targets.resize( options.frames_in_flight );
+		for ( auto &target : scene_targets ) {
+			createTargetImage( swap_chain_image_format, sceneUsage(), swap_chain_extent, 1, concurrent,
+							   target.scene, target.scene_allocation );
+			target.scene_view = createTargetView( target.scene, swap_chain_image_format, 0, 1 );
+			createTargetImage( POST_FORMAT, vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferSrc,
+							   swap_chain_extent, 1, concurrent, target.post, target.post_allocation );
+			target.post_view = createTargetView( target.post, POST_FORMAT, 0, 1 );
+
+			auto frame_buffer_info =
+			  vk::FramebufferCreateInfo()
+				.setRenderPass( render_pass )
+				.setAttachmentCount( 1 )
+				.setPAttachments( &target.scene_view )
+				.setWidth( swap_chain_extent.width )
+				.setHeight( swap_chain_extent.height )
+				.setLayers( 1 );
+
+			if ( device.createFramebuffer( &frame_buffer_info, nullptr, &target.frame_buffer ) != vk::Result::eSuccess ) {
+				throw std::runtime_error( "failed to create scene framebuffer" );
+			}
+		}
+	}
+
+	// the render pass and pipelines are built for the target's format, so the scene uses it too
+	vk::ImageUsageFlags sceneUsage() const
+	{
+		auto usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled;
+		if ( options.views > 1 ) {
+			// the views are tiled into it instead
+			usage |= vk::ImageUsageFlagBits::eTransferDst;
+		}
+		return usage;
+	}
+
+	/* framebuffers over the frame graph's own images, which every compile()
+	   replaces: the serially post processed scene's, and with several views
+	   one over the whole array for multiview or one per layer otherwise */
+	void createGraphTargets()
+	{
+		if ( options.views > 1 ) {
+			view_extent = frame_graph.imageExtent( graph_views, swap_chain_extent );
+			if ( multiview() ) {
+				view_frame_buffers.emplace_back( createGraphFramebuffer( frame_graph.view( graph_views ), view_extent ) );
+			} else {
+				for ( uint32_t i = 0; i < options.views; ++i ) {
+					view_layers.emplace_back( createTargetView( frame_graph.image( graph_views ), swap_chain_image_format, i, 1 ) );
+					view_frame_buffers.emplace_back( createGraphFramebuffer( view_layers.back(), view_extent ) );
+				}
+			}
+		} else if ( options.post_mode == PostMode::Serial ) {
+			scene_frame_buffer = createGraphFramebuffer( frame_graph.view( graph_scene ), swap_chain_extent );
+		}
+	}
+
+	vk::Framebuffer createGraphFramebuffer( vk::ImageView view, vk::Extent2D extent )
+	{
+		auto frame_buffer_info =
+		  vk::FramebufferCreateInfo()
+			.setRenderPass( mainRenderPass() )
+			.setAttachmentCount( 1 )
+			.setPAttachments( &view )
+			.setWidth( extent.width )
+			.setHeight( extent.height )
+			// a multiview framebuffer has one layer, the view mask picks the image's
+			.setLayers( 1 );
+
+		vk::Framebuffer frame_buffer;
+		if ( device.createFramebuffer( &frame_buffer_info, nullptr, &frame_buffer ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to create graph framebuffer" );
+		}
+		return frame_buffer;
+	}
+
+	/* a device local color image; concurrent ones may be used by the
+	   graphics and the compute family without ownership transfers */
+	void createTargetImage( vk::Format format, vk::ImageUsageFlags usage, vk::Extent2D extent, uint32_t layers,
+							bool concurrent, vk::Image &image, Allocation &allocation )
+	{
+		auto indices = findQueueFamilies( physical_device );
+		uint32_t families[] = { indices.graphics_family.value(), indices.compute_family.value() };
+		auto image_info =
+		  vk::ImageCreateInfo()
+			.setImageType( vk::ImageType::e2D )
+			.setFormat( format )
+			.setExtent( vk::Extent3D{ extent.width, extent.height, 1 } )
+			.setMipLevels( 1 )
+			.setArrayLayers( layers )
+			.setSamples( vk::SampleCountFlagBits::e1 )
+			.setTiling( vk::ImageTiling::eOptimal )
+			.setUsage( usage )
+			.setSharingMode( concurrent ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive )
+			.setQueueFamilyIndexCount( concurrent ? 2 : 0 )
+			.setPQueueFamilyIndices( families )
+			.setInitialLayout( vk::ImageLayout::eUndefined );
+
+		if ( device.createImage( &image_info, nullptr, &image ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to create render target image" );
+		}
+		allocation = allocator.allocateImage( image, vk::MemoryPropertyFlagBits::eDeviceLocal );
+	}
+
+	// a view of layers of image, an array view if there are several
+	vk::ImageView createTargetView( vk::Image image, vk::Format format, uint32_t first_layer, uint32_t layers )
+	{
+		auto view_info =
+		  vk::ImageViewCreateInfo()
+			.setImage( image )
+			.setViewType( layers > 1 ? vk::ImageViewType::e2DArray : vk::ImageViewType::e2D )
+			.setFormat( format );
+		view_info.subresourceRange
+		  .setAspectMask( vk::ImageAspectFlagBits::eColor )
+		  .setBaseMipLevel( 0 )
+		  .setLevelCount( 1 )
+		  .setBaseArrayLayer( first_layer )
+		  .setLayerCount( layers );
+
+		vk::ImageView view;
+		if ( device.createImageView( &view_info, nullptr, &view ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to create render target image view" );
+		}
+		return view;
+	}
+
+	/* what the mesh is drawn into: the target, with post processing the
+	   scene (the slot's own when async), with several views the layer for
+	   view or all of them at once */
+	vk::Framebuffer mainFramebuffer( size_t slot, uint32_t image_index, uint32_t view = 0 ) const
+	{
+		if ( !view_frame_buffers.empty() ) {
+			return view_frame_buffers[ view ];
+		}
+		if ( !scene_targets.empty() ) {
+			return scene_targets[ slot ].frame_buffer;
+		}
+		return scene_frame_buffer ? scene_frame_buffer : swap_chain_frame_buffers[ image_index ];
+	}
+
+	// the size the mesh is drawn at: the target's, or a view's tile
+	vk::Extent2D drawExtent() const
+	{
+		return view_frame_buffers.empty() ? swap_chain_extent : view_extent;
+	}
+
+	/* one transient pool per frame slot: once the slot's frame completes the
+	   whole pool is reset in one call and the frame is recorded from scratch */
+	void createCommandPools()
+	{
+		auto indices = findQueueFamilies( physical_device );
+		auto pool_info =
+		  vk::CommandPoolCreateInfo()
+			.setFlags( vk::CommandPoolCreateFlagBits::eTransient )
+			.setQueueFamilyIndex( indices.graphics_family.value() );
+
+		command_pools.resize( options.frames_in_flight );
+		for ( auto &command_pool : command_pools ) {
+			if ( device.createCommandPool( &pool_info, nullptr, &command_pool ) != vk::Result::eSuccess ) {
+				throw std::runtime_error( "failed to create command pool" );
+			}
+		}
+		if ( options.post_mode != PostMode::Async ) {
+			return;
+		}
+		pool_info.setQueueFamilyIndex( indices.compute_family.value() );
+		compute_pools.resize( options.frames_in_flight );
+		for ( auto &command_pool : compute_pools ) {
+			if ( device.createCommandPool( &pool_info, nullptr, &command_pool ) != vk::Result::eSuccess ) {
+				throw std::runtime_error( "failed to create compute command pool" );
+			}
+		}
+		if ( indices.compute_family != indices.graphics_family ) {
+			cout << "async post processing on compute queue family " << indices.compute_family.value() << endl;
+		} else {
+			cout << "no separate compute queue family, async post processing shares the graphics queue" << endl;
+		}
+	}
+
+	void createQueryPool()
+	{
+		auto properties = physical_device.getProperties();
+		auto indices = findQueueFamilies( physical_device );
+		auto valid_bits = physical_device.getQueueFamilyProperties()[ indices.graphics_family.value() ].timestampValidBits;
+		if ( !properties.limits.timestampComputeAndGraphics || !valid_bits ) {
+			cout << "gpu timestamps unsupported, gpu frame time disabled" << endl;
+			return;
+		}
+		timestamp_period = properties.limits.timestampPeriod;
+		timestamp_mask = valid_bits >= 64 ? ~0ull : ( 1ull << valid_bits ) - 1;
+
+		// a begin/end pair per frame slot
+		auto pool_info =
+		  vk::QueryPoolCreateInfo()
+			.setQueryType( vk::QueryType::eTimestamp )
+			.setQueryCount( 2 * options.frames_in_flight );
+
+		if ( device.createQueryPool( &pool_info, nullptr, &query_pool ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to create query pool" );
+		}
+	}
+
+	void createCommandBuffers()
+	{
+		command_buffers.resize( options.frames_in_flight );
+		for ( size_t i = 0; i < command_buffers.size(); ++i ) {
+			auto alloc_info =
+			  vk::CommandBufferAllocateInfo()
+				.setCommandPool( command_pools[ i ] )
+				.setLevel( vk::CommandBufferLevel::ePrimary )
+				.setCommandBufferCount( 1 );
+
+			if ( device.allocateCommandBuffers( &alloc_info, &command_buffers[ i ] ) != vk::Result::eSuccess ) {
+				throw std::runtime_error( "failed to allocate command buffer" );
+			}
+		}
+		if ( options.post_mode != PostMode::Async ) {
+			return;
+		}
+		// async post processing splits a frame in three: render, post process, compose
+		compute_buffers.resize( options.frames_in_flight );
+		compose_buffers.resize( options.frames_in_flight );
+		for ( size_t i = 0; i < options.frames_in_flight; ++i ) {
+			auto alloc_info =
+			  vk::CommandBufferAllocateInfo()
+				.setCommandPool( compute_pools[ i ] )
+				.setLevel( vk::CommandBufferLevel::ePrimary )
+				.setCommandBufferCount( 1 );
+
+			if ( device.allocateCommandBuffers( &alloc_info, &compute_buffers[ i ] ) != vk::Result::eSuccess ) {
+				throw std::runtime_error( "failed to allocate compute command buffer" );
+			}
+			alloc_info.setCommandPool( command_pools[ i ] );
+			if ( device.allocateCommandBuffers( &alloc_info, &compose_buffers[ i ] ) != vk::Result::eSuccess ) {
+				throw std::runtime_error( "failed to allocate compose command buffer" );
+			}
+		}
+	}
+
+	/* each worker owns a pool per frame slot and records secondary command
+	   buffers for its slice of the draw list; pools are never shared between
+	   threads, so recording needs no locks */
+	void createRecordWorkers()
+	{
+		if ( !options.record_threads ) {
+			return;
+		}
+		auto indices = findQueueFamilies( physical_device );
+		auto pool_info =
+		  vk::CommandPoolCreateInfo()
+			.setFlags( vk::CommandPoolCreateFlagBits::eTransient )
+			.setQueueFamilyIndex( indices.graphics_family.value() );
+
+		worker_pools.resize( options.record_threads );
+		secondary_buffers.resize( options.record_threads );
+		for ( uint32_t i = 0; i < options.record_threads; ++i ) {
+			worker_pools[ i ].resize( options.frames_in_flight );
+			secondary_buffers[ i ].resize( options.frames_in_flight );
+			for ( size_t j = 0; j < options.frames_in_flight; ++j ) {
+				if ( device.createCommandPool( &pool_info, nullptr, &worker_pools[ i ][ j ] ) != vk::Result::eSuccess ) {
+					throw std::runtime_error( "failed to create worker command pool" );
+				}
+				auto alloc_info =
+				  vk::CommandBufferAllocateInfo()
+					.setCommandPool( worker_pools[ i ][ j ] )
+					.setLevel( vk::CommandBufferLevel::eSecondary )
+					.setCommandBufferCount( 1 );
+
+				if ( device.allocateCommandBuffers( &alloc_info, &secondary_buffers[ i ][ j ] ) != vk::Result::eSuccess ) {
+					throw std::runtime_error( "failed to allocate secondary command buffer" );
+				}
+			}
+		}
+		workers = make_unique<WorkerPool>( options.record_threads );
+	}
+
+	void recordSecondary( uint32_t worker, size_t slot, uint32_t image_index )
+	{
+		device.resetCommandPool( worker_pools[ worker ][ slot ], vk::CommandPoolResetFlags{} );
+
+		auto inheritance_info =
+		  vk::CommandBufferInheritanceInfo()
+			.setRenderPass( mainRenderPass() )
+			.setSubpass( 0 )
+			.setFramebuffer( mainFramebuffer( slot, image_index ) );
+
+		auto begin_info =
+		  vk::CommandBufferBeginInfo()
+			.setFlags( vk::CommandBufferUsageFlagBits::eOneTimeSubmit |
+					   vk::CommandBufferUsageFlagBits::eRenderPassContinue )
+			.setPInheritanceInfo( &inheritance_info );
+
+		auto &command_buffer = secondary_buffers[ worker ][ slot ];
+		if ( command_buffer.begin( &begin_info ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to begin recording secondary command buffer" );
+		}
+
+		uint64_t draw_cnt = options.draw_count;
+		uint64_t worker_cnt = options.record_threads;
+		recordDraws( command_buffer, slot, draw_cnt * worker / worker_cnt, draw_cnt * ( worker + 1 ) / worker_cnt );
+
+		if ( vkEndCommandBuffer( command_buffer ) != VK_SUCCESS ) {
+			throw std::runtime_error( "failed to record secondary command buffer" );
+		}
+	}
+
+	// state set here is not inherited by secondaries, so each buffer sets its own
+	void recordDraws( vk::CommandBuffer command_buffer, size_t slot, uint32_t first_draw, uint32_t end_draw,
+					  uint32_t view = 0 )
+	{
+		auto bound_pipeline = variant_pipelines[ first_draw % variant_pipelines.size() ];
+		command_buffer.bindPipeline( vk::PipelineBindPoint::eGraphics, bound_pipeline );
+		// every variant shares the layout, so the set stays bound across pipeline switches
+		command_buffer.bindDescriptorSets( vk::PipelineBindPoint::eGraphics, pipeline_layout,
+										   0, 1, &frame_set, 1, &frame_uniform_offset );
+		if ( options.views > 1 ) {
+			command_buffer.bindDescriptorSets( vk::PipelineBindPoint::eGraphics, pipeline_layout,
+											   1, 1, &view_set, 1, &view_uniform_offset );
+		}
+
+		auto extent = drawExtent();
+		auto viewport =
+		  vk::Viewport()
+			.setX( 0.f )
+			.setY( 0.f )
+			.setWidth( extent.width )
+			.setHeight( extent.height )
+			.setMinDepth( 0.f )
+			.setMaxDepth( 1.f );
+		command_buffer.setViewport( 0, 1, &viewport );
+
+		auto scissor =
+		  vk::Rect2D()
+			.setOffset( vk::Offset2D{ 0, 0 } )
+			.setExtent( extent );
+		command_buffer.setScissor( 0, 1, &scissor );
+
+		// until its upload has been flushed the mesh is simply not drawn, nor is an unculled world
+		auto gpu_driven = options.cull_mode == CullMode::Gpu;
+		if ( !mesh.ready() || ( gpu_driven && !objects_ready ) ) {
+			return;
+		}
+		vk::Buffer vertex_buffers[] = { mesh.vertex_buffer, gpu_driven ? instance_buffers[ slot ] : frame_pool.buffer() };
+		vk::DeviceSize offsets[] = { 0, gpu_driven ? 0 : instance_offset };
+		command_buffer.bindVertexBuffers( 0, 2, vertex_buffers, offsets );
+		command_buffer.bindIndexBuffer( mesh.index_buffer, 0, vk::IndexType::eUint32 );
+
+		for ( uint32_t j = first_draw; j < end_draw; ++j ) {
+			// consecutive draws often resolve to the same pipeline, only switch when it changes
+			auto pipeline = variant_pipelines[ j % variant_pipelines.size() ];
+			if ( pipeline != bound_pipeline ) {
+				command_buffer.bindPipeline( vk::PipelineBindPoint::eGraphics, pipeline );
+				bound_pipeline = pipeline;
+			}
+			DrawConstants constants{ float( j ) / options.draw_count, view };
+			command_buffer.pushConstants( pipeline_layout, vk::ShaderStageFlagBits::eVertex,
+										  0, sizeof( constants ), &constants );
+			if ( gpu_driven ) {
+				command_buffer.drawIndexedIndirect( indirect_buffers[ slot ], 0, 1,
+													sizeof( vk::DrawIndexedIndirectCommand ) );
+			} else {
+				command_buffer.drawIndexed( mesh.index_count, drawn_instances, 0, 0, 0 );
+			}
+		}
+	}
+
+	void recordCapture( vk::CommandBuffer command_buffer )
+	{
+		if ( !capture_buffer ) {
+			return;
+		}
+		// tightly packed rows, 4 bytes per pixel
+		auto region =
+		  vk::BufferImageCopy()
+			.setBufferOffset( 0 )
+			.setBufferRowLength( 0 )
+			.setBufferImageHeight( 0 )
+			.setImageOffset( vk::Offset3D{ 0, 0, 0 } )
+			.setImageExtent( vk::Extent3D{ swap_chain_extent.width, swap_chain_extent.height, 1 } );
+		region.imageSubresource
+		  .setAspectMask( vk::ImageAspectFlagBits::eColor )
+		  .setMipLevel( 0 )
+		  .setBaseArrayLayer( 0 )
+		  .setLayerCount( 1 );
+		command_buffer.copyImageToBuffer( outputGraph().image( graph_target ), vk::ImageLayout::eTransferSrcOptimal,
+										  capture_buffer, 1, &region );
+	}
+
+	// resets the slot's indirect draw and culls the world into it, outside the render pass
+	void recordCulling( vk::CommandBuffer command_buffer, size_t slot )
+	{
+		auto draw =
+		  vk::DrawIndexedIndirectCommand()
+			.setIndexCount( mesh.index_count )
+			.setInstanceCount( 0 )
+			.setFirstIndex( 0 )
+			.setVertexOffset( 0 )
+			.setFirstInstance( 0 );
+		command_buffer.updateBuffer( indirect_buffers[ slot ], 0, sizeof( draw ), &draw );
+
+		auto reset_barrier =
+		  vk::BufferMemoryBarrier()
+			.setSrcAccessMask( vk::AccessFlagBits::eTransferWrite )
+			.setDstAccessMask( vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite )
+			.setSrcQueueFamilyIndex( VK_QUEUE_FAMILY_IGNORED )
+			.setDstQueueFamilyIndex( VK_QUEUE_FAMILY_IGNORED )
+			.setBuffer( indirect_buffers[ slot ] )
+			.setOffset( 0 )
+			.setSize( VK_WHOLE_SIZE );
+		command_buffer.pipelineBarrier( vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader,
+										vk::DependencyFlags{}, 0, nullptr, 1, &reset_barrier, 0, nullptr );
+
+		auto view = cullView();
+		command_buffer.bindPipeline( vk::PipelineBindPoint::eCompute, cull_pipeline );
+		command_buffer.bindDescriptorSets( vk::PipelineBindPoint::eCompute, cull_pipeline_layout,
+										   0, 1, &cull_sets[ slot ], 0, nullptr );
+		command_buffer.pushConstants( cull_pipeline_layout, vk::ShaderStageFlagBits::eCompute,
+									  0, sizeof( view ), &view );
+		command_buffer.dispatch( ( view.object_count + CULL_GROUP_SIZE - 1 ) / CULL_GROUP_SIZE, 1, 1 );
+	}
+
+	/* the passes of a frame and what they touch; barriers between them and
+	   the target's layout transitions all come out of the graph */
+	void createFrameGraph()
+	{
+		auto post = options.post_mode != PostMode::Off;
+		auto async = options.post_mode == PostMode::Async;
+		// the target is only touched where the finished frame is composed
+		auto &output_graph = outputGraph();
+		graph_target = output_graph.importImage( "target", { vk::PipelineStageFlagBits::eColorAttachmentOutput,
+															 vk::AccessFlags{}, vk::ImageLayout::eUndefined } );
+		graph_instances = frame_graph.importBuffer( "instances" );
+
+		if ( options.cull_mode == CullMode::Gpu ) {
+			graph_objects = frame_graph.importBuffer( "objects" );
+			graph_indirect = frame_graph.importBuffer( "indirect" );
+
+			auto cull = frame_graph.addPass( "cull", [this]( const FrameContext &context ) {
+				if ( objects_ready ) {
+					recordCulling( context.command_buffer, context.slot );
+				}
+			} );
+			frame_graph.read( cull, graph_objects, { vk::PipelineStageFlagBits::eComputeShader,
+													 vk::AccessFlagBits::eShaderRead } );
+			frame_graph.write( cull, graph_instances, { vk::PipelineStageFlagBits::eComputeShader,
+														vk::AccessFlagBits::eShaderWrite } );
+			// reset by a transfer inside the pass, then counted into by the shader
+			frame_graph.write( cull, graph_indirect, { vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader,
+													   vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eShaderRead |
+														 vk::AccessFlagBits::eShaderWrite } );
+		}
+
+		/* with post processing the mesh is drawn into a scene image instead:
+		   the slot's own when async, since the compute queue reads it after
+		   this graph's submission, otherwise one of the graph's transients */
+		auto color = graph_target;
+		if ( async ) {
+			graph_scene = frame_graph.importImage( "scene", { vk::PipelineStageFlagBits::eColorAttachmentOutput,
+															  vk::AccessFlags{}, vk::ImageLayout::eUndefined } );
+			color = graph_scene;
+		} else if ( post ) {
+			graph_scene = frame_graph.createImage( "scene", swap_chain_image_format, sceneUsage() );
+			color = graph_scene;
+		}
+		/* with several views the mesh is drawn into a transient array of
+		   tiles, which are then copied into that */
+		auto drawn = color;
+		if ( options.views > 1 ) {
+			view_columns = static_cast<uint32_t>( std::ceil( std::sqrt( double( options.views ) ) ) );
+			auto rows = ( options.views + view_columns - 1 ) / view_columns;
+			graph_views = frame_graph.createImage( "views", swap_chain_image_format,
+												   vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc,
+												   options.views, { view_columns, rows } );
+			drawn = graph_views;
+		}
+		auto main_pass = frame_graph.addPass( "main", [this]( const FrameContext &context ) {
+			recordMainPass( context.command_buffer, context.slot, context.image_index );
+		} );
+		frame_graph.read( main_pass, graph_instances, { vk::PipelineStageFlagBits::eVertexInput,
+														vk::AccessFlagBits::eVertexAttributeRead } );
+		if ( options.cull_mode == CullMode::Gpu ) {
+			frame_graph.read( main_pass, graph_indirect, { vk::PipelineStageFlagBits::eDrawIndirect,
+														   vk::AccessFlagBits::eIndirectCommandRead } );
+		}
+		frame_graph.write( main_pass, drawn, { vk::PipelineStageFlagBits::eColorAttachmentOutput,
+											   vk::AccessFlagBits::eColorAttachmentWrite,
+											   vk::ImageLayout::eColorAttachmentOptimal } );
+		if ( options.views > 1 ) {
+			auto tile_pass = frame_graph.addPass( "tile", [this, color]( const FrameContext &context ) {
+				recordTiles( context.command_buffer, frame_graph.image( color ) );
+			} );
+			frame_graph.read( tile_pass, graph_views, { vk::PipelineStageFlagBits::eTransfer,
+														vk::AccessFlagBits::eTransferRead,
+														vk::ImageLayout::eTransferSrcOptimal } );
+			frame_graph.write( tile_pass, color, { vk::PipelineStageFlagBits::eTransfer,
+												   vk::AccessFlagBits::eTransferWrite,
+												   vk::ImageLayout::eTransferDstOptimal } );
+		}
+
+		if ( async ) {
+			/* the compute queue picks the scene up behind a semaphore, which
+			   covers the memory dependency; only the layout is left to change */
+			frame_graph.output( graph_scene, { vk::PipelineStageFlagBits::eBottomOfPipe, vk::AccessFlags{},
+											   vk::ImageLayout::eShaderReadOnlyOptimal } );
+			// written by the compute queue, whose semaphore is waited on at the transfer stage
+			graph_post = compose_graph.importImage( "post", { vk::PipelineStageFlagBits::eTransfer,
+															  vk::AccessFlags{}, vk::ImageLayout::eGeneral } );
+		} else if ( post ) {
+			// lives from here to the compose pass, so with several views it can alias their array
+			graph_post = frame_graph.createImage( "post", POST_FORMAT,
+												  vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferSrc );
+			auto post_pass = frame_graph.addPass( "post", [this]( const FrameContext &context ) {
+				recordPost( context.command_buffer, context.slot,
+							frame_graph.view( graph_scene ), frame_graph.view( graph_post ) );
+			} );
+			frame_graph.read( post_pass, graph_scene, { vk::PipelineStageFlagBits::eComputeShader,
+														vk::AccessFlagBits::eShaderRead,
+														vk::ImageLayout::eShaderReadOnlyOptimal } );
+			frame_graph.write( post_pass, graph_post, { vk::PipelineStageFlagBits::eComputeShader,
+														vk::AccessFlagBits::eShaderWrite,
+														vk::ImageLayout::eGeneral } );
+		}
+		if ( post ) {
+			auto compose_pass = output_graph.addPass( "compose", [this]( const FrameContext &context ) {
+				recordCompose( context.command_buffer );
+			} );
+			output_graph.read( compose_pass, graph_post, { vk::PipelineStageFlagBits::eTransfer,
+														   vk::AccessFlagBits::eTransferRead,
+														   vk::ImageLayout::eTransferSrcOptimal } );
+			output_graph.write( compose_pass, graph_target, { vk::PipelineStageFlagBits::eTransfer,
+															  vk::AccessFlagBits::eTransferWrite,
+															  vk::ImageLayout::eTransferDstOptimal } );
+		}
+
+		// declared after the target's writer, so it reads the finished frame
+		if ( !options.capture_path.empty() ) {
+			graph_capture = output_graph.importBuffer( "capture" );
+			auto capture_pass = output_graph.addPass( "capture", [this]( const FrameContext &context ) {
+				recordCapture( context.command_buffer );
+			} );
+			output_graph.read( capture_pass, graph_target, { vk::PipelineStageFlagBits::eTransfer,
+															 vk::AccessFlagBits::eTransferRead,
+															 vk::ImageLayout::eTransferSrcOptimal } );
+			output_graph.write( capture_pass, graph_capture, { vk::PipelineStageFlagBits::eTransfer,
+															   vk::AccessFlagBits::eTransferWrite } );
+			// the final barrier makes the copy visible to the writer thread's reads
+			output_graph.output( graph_capture, { vk::PipelineStageFlagBits::eHost, vk::AccessFlagBits::eHostRead } );
+		}
+
+		output_graph.output( graph_target, { vk::PipelineStageFlagBits::eBottomOfPipe, vk::AccessFlags{},
+											 options.headless ? vk::ImageLayout::eTransferSrcOptimal
+															  : vk::ImageLayout::ePresentSrcKHR } );
+		frame_graph.compile( device, allocator, swap_chain_extent );
+		printGraph( "frame graph", frame_graph );
+		if ( async ) {
+			compose_graph.compile( device, allocator, swap_chain_extent );
+			printGraph( "compose graph", compose_graph );
+		}
+		createGraphTargets();
+	}
+
+	static void printGraph( const char *what, const RenderGraph &graph )
+	{
+		auto &stats = graph.getStats();
+		cout << what << ":";
+		for ( auto &name : graph.passOrder() ) {
+			cout << " " << name;
+		}
+		cout << ", " << stats.culled_passes << " passes culled, "
+			 << stats.barriers << " barriers in " << stats.barrier_batches << " batches, "
+			 << stats.transient_images << " transient images in " << stats.aliased_bytes
+			 << " of " << stats.transient_bytes << " bytes" << endl;
+	}
+
+	// the graph that writes the target: the frame's own, or with async post processing the compose submission's
+	RenderGraph &outputGraph()
+	{
+		return options.post_mode == PostMode::Async ? compose_graph : frame_graph;
+	}
+
+	// copies each view into its tile of image, a grid filled row by row
+	void recordTiles( vk::CommandBuffer command_buffer, vk::Image image )
+	{
+		// tiles left over in the last row and the remainder of the division stay black
+		vk::ClearColorValue black( std::array<float, 4>{ 0.f, 0.f, 0.f, 1.f } );
+		vk::ImageSubresourceRange range( vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 );
+		command_buffer.clearColorImage( image, vk::ImageLayout::eTransferDstOptimal, &black, 1, &range );
+		auto barrier =
+		  vk::MemoryBarrier()
+			.setSrcAccessMask( vk::AccessFlagBits::eTransferWrite )
+			.setDstAccessMask( vk::AccessFlagBits::eTransferWrite );
+		command_buffer.pipelineBarrier( vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer,
+										vk::DependencyFlags{}, 1, &barrier, 0, nullptr, 0, nullptr );
+
+		vector<vk::ImageCopy> regions;
+		for ( uint32_t i = 0; i < options.views; ++i ) {
+			auto region =
+			  vk::ImageCopy()
+				.setSrcSubresource( vk::ImageSubresourceLayers( vk::ImageAspectFlagBits::eColor, 0, i, 1 ) )
+				.setSrcOffset( vk::Offset3D( 0, 0, 0 ) )
+				.setDstSubresource( vk::ImageSubresourceLayers( vk::ImageAspectFlagBits::eColor, 0, 0, 1 ) )
+				.setDstOffset( vk::Offset3D( i % view_columns * view_extent.width, i / view_columns * view_extent.height, 0 ) )
+				.setExtent( vk::Extent3D( view_extent.width, view_extent.height, 1 ) );
+			regions.emplace_back( region );
+		}
+		command_buffer.copyImage( frame_graph.image( graph_views ), vk::ImageLayout::eTransferSrcOptimal,
+								  image, vk::ImageLayout::eTransferDstOptimal, regions.size(), regions.data() );
+	}
+
+	// blits the post processed image to the target, converting the format on the way
+	void recordCompose( vk::CommandBuffer command_buffer )
+	{
+		vk::ImageSubresourceLayers layers( vk::ImageAspectFlagBits::eColor, 0, 0, 1 );
+		vk::Offset3D extent( swap_chain_extent.width, swap_chain_extent.height, 1 );
+		auto blit =
+		  vk::ImageBlit()
+			.setSrcSubresource( layers )
+			.setSrcOffsets( { vk::Offset3D( 0, 0, 0 ), extent } )
+			.setDstSubresource( layers )
+			.setDstOffsets( { vk::Offset3D( 0, 0, 0 ), extent } );
+		command_buffer.blitImage( outputGraph().image( graph_post ), vk::ImageLayout::eTransferSrcOptimal,
+								  outputGraph().image( graph_target ), vk::ImageLayout::eTransferDstOptimal,
+								  1, &blit, vk::Filter::eNearest );
+	}
+
+	// blurs and tonemaps scene into post, both already in the layouts used here
+	void recordPost( vk::CommandBuffer command_buffer, size_t slot, vk::ImageView scene, vk::ImageView post )
+	{
+		// a transient set, recycled with the slot
+		auto set = frame_descriptors[ slot ].allocate( post_set_layout );
+		vk::DescriptorImageInfo image_infos[] = {
+			vk::DescriptorImageInfo( post_sampler, scene, vk::ImageLayout::eShaderReadOnlyOptimal ),
+			vk::DescriptorImageInfo( vk::Sampler{}, post, vk::ImageLayout::eGeneral )
+		};
+		vk::WriteDescriptorSet writes[ 2 ];
+		for ( uint32_t i = 0; i < 2; ++i ) {
+			writes[ i ]
+			  .setDstSet( set )
+			  .setDstBinding( i )
+			  .setDescriptorCount( 1 )
+			  .setDescriptorType( i ? vk::DescriptorType::eStorageImage : vk::DescriptorType::eCombinedImageSampler )
+			  .setPImageInfo( &image_infos[ i ] );
+		}
+		device.updateDescriptorSets( 2, writes, 0, nullptr );
+
+		PostConstants constants{ 2.f, 1.f };
+		command_buffer.bindPipeline( vk::PipelineBindPoint::eCompute, post_pipeline );
+		command_buffer.bindDescriptorSets( vk::PipelineBindPoint::eCompute, post_pipeline_layout,
+										   0, 1, &set, 0, nullptr );
+		command_buffer.pushConstants( post_pipeline_layout, vk::ShaderStageFlagBits::eCompute,
+									  0, sizeof( constants ), &constants );
+		command_buffer.dispatch( ( swap_chain_extent.width + POST_GROUP_SIZE - 1 ) / POST_GROUP_SIZE,
+								 ( swap_chain_extent.height + POST_GROUP_SIZE - 1 ) / POST_GROUP_SIZE, 1 );
+	}
+
+	/* the compute queue's part of an async frame: the scene arrives in
+	   shader read layout behind the render semaphore, the post image only
+	   needs its layout, since it is overwritten whole */
+	void recordComputeBuffer( size_t slot )
+	{
+		device.resetCommandPool( compute_pools[ slot ], vk::CommandPoolResetFlags{} );
+
+		auto &command_buffer = compute_buffers[ slot ];
+		auto begin_info =
+		  vk::CommandBufferBeginInfo()
+			.setFlags( vk::CommandBufferUsageFlagBits::eOneTimeSubmit );
+
+		if ( command_buffer.begin( &begin_info ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to begin recording compute command buffer" );
+		}
+
+		auto barrier =
+		  vk::ImageMemoryBarrier()
+			.setSrcAccessMask( vk::AccessFlags{} )
+			.setDstAccessMask( vk::AccessFlagBits::eShaderWrite )
+			.setOldLayout( vk::ImageLayout::eUndefined )
+			.setNewLayout( vk::ImageLayout::eGeneral )
+			.setSrcQueueFamilyIndex( VK_QUEUE_FAMILY_IGNORED )
+			.setDstQueueFamilyIndex( VK_QUEUE_FAMILY_IGNORED )
+			.setImage( scene_targets[ slot ].post );
+		barrier.subresourceRange
+		  .setAspectMask( vk::ImageAspectFlagBits::eColor )
+		  .setBaseMipLevel( 0 )
+		  .setLevelCount( 1 )
+		  .setBaseArrayLayer( 0 )
+		  .setLayerCount( 1 );
+		command_buffer.pipelineBarrier( vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eComputeShader,
+										vk::DependencyFlags{}, 0, nullptr, 0, nullptr, 1, &barrier );
+
+		recordPost( command_buffer, slot, scene_targets[ slot ].scene_view, scene_targets[ slot ].post_view );
+
+		if ( vkEndCommandBuffer( command_buffer ) != VK_SUCCESS ) {
+			throw std::runtime_error( "failed to record compute command buffer" );
+		}
+	}
+
+	// the last graphics submission of an async frame: the post image goes to the target
+	void recordComposeBuffer( size_t slot, uint32_t image_index )
+	{
+		auto &command_buffer = compose_buffers[ slot ];
+		auto begin_info =
+		  vk::CommandBufferBeginInfo()
+			.setFlags( vk::CommandBufferUsageFlagBits::eOneTimeSubmit );
+
+		if ( command_buffer.begin( &begin_info ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to begin recording compose command buffer" );
+		}
+
+		bindOutputs( compose_graph, slot, image_index );
+		compose_graph.execute( FrameContext{ command_buffer, slot, image_index } );
+
+		if ( vkEndCommandBuffer( command_buffer ) != VK_SUCCESS ) {
+			throw std::runtime_error( "failed to record compose command buffer" );
+		}
+	}
+
+	// the target and what is derived from it, in whichever graph writes the target
+	void bindOutputs( RenderGraph &graph, size_t slot, uint32_t image_index )
+	{
+		graph.bind( graph_target, swap_chain_images[ image_index ], swap_chain_image_views[ image_index ] );
+		// serially the post image is the frame graph's own
+		if ( options.post_mode == PostMode::Async ) {
+			graph.bind( graph_post, scene_targets[ slot ].post, scene_targets[ slot ].post_view );
+		}
+		if ( !options.capture_path.empty() ) {
+			capture_buffer = capture.begin( allocator, frame_number, slot, swap_chain_extent,
+											isBgra( swap_chain_image_format ) );
+			// a dropped frame records no copy, the graph's barriers just need some buffer
+			graph.bind( graph_capture, capture_buffer ? capture_buffer : capture.dropBuffer() );
+		}
+	}
+
+	void recordCommandBuffer( size_t slot, uint32_t image_index, const Uploader::Flush &upload )
+	{
+		// the slot's frame has completed, nothing allocated from its pool is in use
+		device.resetCommandPool( command_pools[ slot ], vk::CommandPoolResetFlags{} );
+
+		auto &command_buffer = command_buffers[ slot ];
+		auto begin_info =
+		  vk::CommandBufferBeginInfo()
+			.setFlags( vk::CommandBufferUsageFlagBits::eOneTimeSubmit );
+
+		if ( command_buffer.begin( &begin_info ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to begin recording command buffer" );
+		}
+
+		if ( query_pool ) {
+			command_buffer.resetQueryPool( query_pool, 2 * slot, 2 );
+			command_buffer.writeTimestamp( vk::PipelineStageFlagBits::eTopOfPipe, query_pool, 2 * slot );
+		}
+
+		// take ownership of buffers the transfer queue released this frame, once: later frames are queued behind it
+		if ( !upload.acquire_barriers.empty() ) {
+			command_buffer.pipelineBarrier( upload.stages, upload.stages, vk::DependencyFlags{},
+											0, nullptr,
+											upload.acquire_barriers.size(), upload.acquire_barriers.data(),
+											0, nullptr );
+		}
+
+		frame_graph.bind( graph_instances, options.cull_mode == CullMode::Gpu ? instance_buffers[ slot ] : frame_pool.buffer() );
+		if ( options.cull_mode == CullMode::Gpu ) {
+			frame_graph.bind( graph_objects, object_buffer );
+			frame_graph.bind( graph_indirect, indirect_buffers[ slot ] );
+		}
+		if ( options.post_mode == PostMode::Async ) {
+			frame_graph.bind( graph_scene, scene_targets[ slot ].scene, scene_targets[ slot ].scene_view );
+		}
+		if ( options.post_mode != PostMode::Async ) {
+			bindOutputs( frame_graph, slot, image_index );
+		}
+
+		// before resolving, so nothing released here is recorded into this frame
+		promoteReload();
+		// variants still compiling draw with the base pipeline instead of stalling the frame
+		graphics_pipeline = pipelines.get( base_pipeline, graphics_pipeline );
+		variant_pipelines.resize( pipeline_variants.size() );
+		for ( size_t i = 0; i < pipeline_variants.size(); ++i ) {
+			variant_pipelines[ i ] = pipelines.get( pipeline_variants[ i ], graphics_pipeline );
+		}
+
+		frame_graph.execute( FrameContext{ command_buffer, slot, image_index } );
+
+		if ( query_pool ) {
+			command_buffer.writeTimestamp( vk::PipelineStageFlagBits::eBottomOfPipe, query_pool, 2 * slot + 1 );
+		}
+
+		if ( vkEndCommandBuffer( command_buffer ) != VK_SUCCESS ) {
+			// if ( command_buffer.end() != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to record command buffer" );
+		}
+	}
+
+	void recordMainPass( vk::CommandBuffer command_buffer, size_t slot, uint32_t image_index )
+	{
+		// without multiview, each of several views is a render pass instance and a recording of every draw
+		if ( options.views > 1 && !multiview() ) {
+			for ( uint32_t view = 0; view < options.views; ++view ) {
+				recordMainPass( command_buffer, slot, image_index, view );
+			}
+		} else {
+			recordMainPass( command_buffer, slot, image_index, 0 );
+		}
+	}
+
+	void recordMainPass( vk::CommandBuffer command_buffer, size_t slot, uint32_t image_index, uint32_t view )
+	{
+		auto render_pass_info =
+		  vk::RenderPassBeginInfo()
+			.setRenderPass( mainRenderPass() )
+			.setFramebuffer( mainFramebuffer( slot, image_index, view ) );
+		render_pass_info.renderArea
+		  .setOffset( 0 )
+		  .setExtent( drawExtent() );
+
+		vk::ClearValue clear_color =
+		  vk::ClearColorValue()
+			.setFloat32( { 0.f, 0.f, 0.f, 1.f } );
+		render_pass_info.setClearValueCount( 1 )
+		  .setPClearValues( &clear_color );
+
+		if ( workers ) {
+			command_buffer.beginRenderPass( &render_pass_info, vk::SubpassContents::eSecondaryCommandBuffers );
+			workers->run( [&]( uint32_t worker ) { recordSecondary( worker, slot, image_index ); } );
+
+			vector<vk::CommandBuffer> secondaries;
+			for ( auto &buffers : secondary_buffers ) {
+				secondaries.emplace_back( buffers[ slot ] );
+			}
+			command_buffer.executeCommands( secondaries.size(), secondaries.data() );
+		} else {
+			command_buffer.beginRenderPass( &render_pass_info, vk::SubpassContents::eInline );
+			recordDraws( command_buffer, slot, 0, options.draw_count, view );
+		}
+		command_buffer.endRenderPass();
+	}
+
+	/* host visible memory for everything the cpu writes per frame: the
+	   uniforms and, unless the gpu culls, the drawn instances. A region per
+	   frame slot, recycled when the slot's frame completes */
+	void createFramePool()
+	{
+		auto region_size = UNIFORM_REGION_SIZE;
+		vk::BufferUsageFlags usage = vk::BufferUsageFlagBits::eUniformBuffer;
+		if ( options.cull_mode != CullMode::Gpu ) {
+			region_size += options.instance_count * sizeof( InstanceData );
+			usage |= vk::BufferUsageFlagBits::eVertexBuffer;
+		}
+		frame_pool.init( device, allocator, region_size, options.frames_in_flight, usage,
+						 vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent );
+	}
+
+	/* long lived sets come from one allocator that is never reset, transient
+	   ones from the slot's allocator, recycled with the slot. The frame set is
+	   written once: only its dynamic offset changes from frame to frame */
+	void createDescriptors()
+	{
+		static_descriptors.init( device );
+		frame_descriptors.resize( options.frames_in_flight );
+		for ( auto &descriptors : frame_descriptors ) {
+			descriptors.init( device );
+		}
+		uniforms.init( physical_device.getProperties().limits, UNIFORM_BLOCK_RANGE, frame_pool );
+
+		frame_set = static_descriptors.allocate( frame_set_layout );
+		auto buffer_info = uniforms.descriptorInfo();
+		auto write =
+		  vk::WriteDescriptorSet()
+			.setDstSet( frame_set )
+			.setDstBinding( 0 )
+			.setDescriptorCount( 1 )
+			.setDescriptorType( vk::DescriptorType::eUniformBufferDynamic )
+			.setPBufferInfo( &buffer_info );
+		device.updateDescriptorSets( 1, &write, 0, nullptr );
+
+		// the view matrices come from the same ring, so the set is written once as well
+		if ( options.views > 1 ) {
+			view_set = static_descriptors.allocate( view_set_layout );
+			write.setDstSet( view_set );
+			device.updateDescriptorSets( 1, &write, 0, nullptr );
+		}
+	}
+
+	/* the first view is the frame's own; the others turn around its center
+	   and zoom in by at least 1.5, which keeps them inside the first view's
+	   bounds even rotated, so culling against the frame's view covers them */
+	ViewUniforms viewUniforms() const
+	{
+		auto frame = frameUniforms();
+		ViewUniforms result{};
+		for ( uint32_t i = 0; i < options.views; ++i ) {
+			auto angle = 2.f * glm::pi<float>() * i / options.views;
+			auto zoom = i ? 1.5f + .25f * i : 1.f;
+			result.view_proj[ i ] =
+			  glm::scale( glm::mat4( 1.f ), glm::vec3( frame.view_scale * zoom, frame.view_scale * zoom, 1.f ) ) *
+			  glm::rotate( glm::mat4( 1.f ), angle, glm::vec3( 0.f, 0.f, 1.f ) ) *
+			  glm::translate( glm::mat4( 1.f ), glm::vec3( -frame.view_center, 0.f ) );
+		}
+		return result;
+	}
+
+	FrameUniforms frameUniforms() const
+	{
+		chrono::duration<float> time = chrono::steady_clock::now() - run_start;
+		if ( options.cull_mode == CullMode::None ) {
+			return FrameUniforms{ glm::vec2( 0.f ), 1.f, time.count() };
+		}
+		auto view = cullView();
+		return FrameUniforms{ view.center, 1.f / view.half_extent, time.count() };
+	}
+
+	/* the cpu rewrites the drawn instances each frame into the frame pool,
+	   where the gpu reads them in place. With gpu culling each slot's copy is
+	   written by the culling pass instead and stays on the device, next to
+	   the slot's indirect draw; both live as long as the slot */
+	void createInstanceBuffers()
+	{
+		instances.init( options.instance_count, options.cull_mode == CullMode::None ? 1.f : WORLD_EXTENT );
+		if ( options.cull_mode != CullMode::Gpu ) {
+			return;
+		}
+
+		auto buffer_info =
+		  vk::BufferCreateInfo()
+			.setSize( options.instance_count * sizeof( InstanceData ) )
+			.setUsage( vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer )
+			.setSharingMode( vk::SharingMode::eExclusive );
+
+		instance_buffers.resize( options.frames_in_flight );
+		instance_allocations.resize( options.frames_in_flight );
+		for ( size_t i = 0; i < options.frames_in_flight; ++i ) {
+			if ( device.createBuffer( &buffer_info, nullptr, &instance_buffers[ i ] ) != vk::Result::eSuccess ) {
+				throw std::runtime_error( "failed to create instance buffer" );
+			}
+			instance_allocations[ i ] = allocator.allocateBuffer( instance_buffers[ i ],
+																  vk::MemoryPropertyFlagBits::eDeviceLocal );
+		}
+
+		auto indirect_info =
+		  vk::BufferCreateInfo()
+			.setSize( sizeof( vk::DrawIndexedIndirectCommand ) )
+			.setUsage( vk::BufferUsageFlagBits::eIndirectBuffer |
+					   vk::BufferUsageFlagBits::eStorageBuffer |
+					   vk::BufferUsageFlagBits::eTransferDst )
+			.setSharingMode( vk::SharingMode::eExclusive );
+
+		indirect_buffers.resize( options.frames_in_flight );
+		indirect_allocations.resize( options.frames_in_flight );
+		for ( size_t i = 0; i < options.frames_in_flight; ++i ) {
+			if ( device.createBuffer( &indirect_info, nullptr, &indirect_buffers[ i ] ) != vk::Result::eSuccess ) {
+				throw std::runtime_error( "failed to create indirect buffer" );
+			}
+			indirect_allocations[ i ] = allocator.allocateBuffer( indirect_buffers[ i ],
+																  vk::MemoryPropertyFlagBits::eDeviceLocal );
+		}
+	}
+
+	// uploads the static world once and points each slot's culling set at its buffers
+	void createCullResources()
+	{
+		if ( options.cull_mode != CullMode::Gpu ) {
+			return;
+		}
+
+		auto objects = make_shared<vector<InstanceData>>( instances.size() );
+		instances.write( objects->data() );
+		auto size = objects->size() * sizeof( InstanceData );
+		object_buffer = createDeviceBuffer( size, vk::BufferUsageFlagBits::eStorageBuffer, object_allocation );
+		uploader.uploadBuffer( object_buffer, 0, objects->data(), size, [this] { objects_ready = true; }, objects );
+
+		// the slot's buffers never change, so neither do its sets
+		cull_sets.resize( options.frames_in_flight );
+		for ( size_t i = 0; i < options.frames_in_flight; ++i ) {
+			cull_sets[ i ] = static_descriptors.allocate( cull_set_layout );
+			vk::DescriptorBufferInfo buffer_infos[] = {
+				vk::DescriptorBufferInfo( object_buffer, 0, VK_WHOLE_SIZE ),
+				vk::DescriptorBufferInfo( instance_buffers[ i ], 0, VK_WHOLE_SIZE ),
+				vk::DescriptorBufferInfo( indirect_buffers[ i ], 0, VK_WHOLE_SIZE )
+			};
+			auto write =
+			  vk::WriteDescriptorSet()
+				.setDstSet( cull_sets[ i ] )
+				.setDstBinding( 0 )
+				.setDescriptorCount( 3 )
+				.setDescriptorType( vk::DescriptorType::eStorageBuffer )
+				.setPBufferInfo( buffer_infos );
+			device.updateDescriptorSets( 1, &write, 0, nullptr );
+		}
+	}
+
+	// the view pans in a circle across the world, so the visible set keeps changing
+	CullView cullView() const
+	{
+		auto t = frame_number * .01f;
+		return CullView{ glm::vec2( std::cos( t ), std::sin( t ) ) * ( WORLD_EXTENT / 2 ), 1.f, instances.size() };
+	}
+
+	void createSyncObjects()
+	{
+		pending_records.resize( options.frames_in_flight );
+		image_avail_semaphores.resize( options.frames_in_flight );
+		render_finish_semaphores.resize( options.frames_in_flight );
+		slot_frames.assign( options.frames_in_flight, 0 );
+		image_frames.assign( swap_chain_images.size(), 0 );
+
+		auto semaphore_info = vk::SemaphoreCreateInfo();
+
+		for ( size_t i = 0; i < options.frames_in_flight; ++i ) {
+			retired.emplace_back();
+			if ( device.createSemaphore( &semaphore_info, nullptr,
+										 &image_avail_semaphores[ i ] ) != vk::Result::eSuccess ||
+				 device.createSemaphore( &semaphore_info, nullptr,
+										 &render_finish_semaphores[ i ] ) != vk::Result::eSuccess ) {
+				throw std::runtime_error( "failed to create synchronization objects for a frame" );
+			}
+		}
+		if ( options.post_mode == PostMode::Async ) {
+			scene_ready_semaphores.resize( options.frames_in_flight );
+			post_ready_semaphores.resize( options.frames_in_flight );
+			for ( size_t i = 0; i < options.frames_in_flight; ++i ) {
+				if ( device.createSemaphore( &semaphore_info, nullptr,
+											 &scene_ready_semaphores[ i ] ) != vk::Result::eSuccess ||
+					 device.createSemaphore( &semaphore_info, nullptr,
+											 &post_ready_semaphores[ i ] ) != vk::Result::eSuccess ) {
+					throw std::runtime_error( "failed to create post processing semaphores" );
+				}
+			}
+		}
+		// one counter for every frame replaces a fence per slot
+		timeline.init( device );
+		pacer.init( timeline, options.frames_in_flight, options.max_fps, options.target_latency_ms,
+					options.low_latency );
+	}
+
+	/* readback buffers live in cached host memory when there is any, the
+	   writer reads every byte of them */
+	void createCapture()
+	{
+		if ( options.capture_path.empty() ) {
+			return;
+		}
+		auto format = swap_chain_image_format;
+		if ( format != vk::Format::eB8G8R8A8Unorm && format != vk::Format::eB8G8R8A8Srgb &&
+			 format != vk::Format::eR8G8B8A8Unorm && format != vk::Format::eR8G8B8A8Srgb ) {
+			throw std::runtime_error( "capture needs an 8 bit rgba or bgra target, got " + vk::to_string( format ) );
+		}
+		if ( options.capture_format != CaptureFormat::Container &&
+			 mkdir( options.capture_path.c_str(), 0755 ) != 0 && errno != EEXIST ) {
+			throw std::runtime_error( "failed to create capture directory " + options.capture_path );
+		}
+
+		vk::MemoryPropertyFlags properties = vk::MemoryPropertyFlagBits::eHostVisible |
+											 vk::MemoryPropertyFlagBits::eHostCoherent;
+		auto memory_properties = physical_device.getMemoryProperties();
+		for ( uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i ) {
+			auto flags = memory_properties.memoryTypes[ i ].propertyFlags;
+			if ( ( flags & properties ) == properties && ( flags & vk::MemoryPropertyFlagBits::eHostCached ) ) {
+				properties |= vk::MemoryPropertyFlagBits::eHostCached;
+				break;
+			}
+		}
+		capture.init( device, allocator, properties, options.capture_format, options.capture_path, options.capture_buffers );
+		cout << "capturing " << captureFormatName( options.capture_format ) << " frames to "
+			 << options.capture_path << " through " << options.capture_buffers << " readback buffers" << endl;
+	}
+
+	static bool isBgra( vk::Format format )
+	{
+		return format == vk::Format::eB8G8R8A8Unorm || format == vk::Format::eB8G8R8A8Srgb;
+	}
+
+	void createUploader()
+	{
+		auto indices = findQueueFamilies( physical_device );
+		auto transfer_family = indices.transfer_family.value();
+		auto graphics_family = indices.graphics_family.value();
+		if ( transfer_family != graphics_family ) {
+			cout << "uploads on dedicated transfer queue family " << transfer_family << endl;
+		} else {
+			cout << "no dedicated transfer queue family, uploads go through the graphics family" << endl;
+		}
+		uploader.init( device, allocator, transfer_family, graphics_family, transfer_queue, STAGING_RING_SIZE );
+	}
+
+	vk::Buffer createDeviceBuffer( vk::DeviceSize size, vk::BufferUsageFlags usage, Allocation &allocation )
+	{
+		auto buffer_info =
+		  vk::BufferCreateInfo()
+			.setSize( size )
+			.setUsage( usage | vk::BufferUsageFlagBits::eTransferDst )
+			.setSharingMode( vk::SharingMode::eExclusive );
+
+		vk::Buffer buffer;
+		if ( device.createBuffer( &buffer_info, nullptr, &buffer ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to create buffer" );
+		}
+		allocation = allocator.allocateBuffer( buffer, vk::MemoryPropertyFlagBits::eDeviceLocal );
+		return buffer;
+	}
+
+	/* the mesh data is only queued here; it goes out with the first frames,
+	   which wait on the transfer instead of the cpu waiting at startup. A mesh
+	   file is not even read yet, it is queued once the loader has it mapped */
+	void createMesh()
+	{
+		if ( !options.mesh_file.empty() ) {
+			// runs inside the frame loop, where a bad file must not end the run
+			mesh_load = loader.load( options.mesh_file, LoadPriority::Streaming, [this]( AssetLoad &load ) {
+				mesh_load.reset();
+				MeshFileHeader header;
+				try {
+					if ( !load.file ) {
+						throw std::runtime_error( load.error );
+					}
+					header = parseMeshFile( load.file->data(), load.file->size() );
+				} catch ( const std::exception &e ) {
+					cerr << "mesh file failed: " << e.what() << endl;
+					uploadProceduralMesh();
+					return;
+				}
+				auto vertices = load.file->data() + sizeof( header );
+				auto indices = vertices + header.vertex_count * sizeof( Vertex );
+				// the mapping itself is the upload source, kept alive until the copy is recorded
+				uploadMesh( vertices, header.vertex_count, indices, header.index_count, load.file );
+			} );
+			return;
+		}
+		uploadProceduralMesh();
+	}
+
+	// --mesh-triangles, and what a mesh file that fails to load falls back to
+	void uploadProceduralMesh()
+	{
+		auto data = make_shared<MeshData>( buildTriangleMesh( options.mesh_triangles ) );
+		uploadMesh( data->vertices.data(), data->vertices.size(), data->indices.data(), data->indices.size(), data );
+	}
+
+	void uploadMesh( const void *vertices, size_t vertex_count, const void *indices, size_t index_count,
+					 shared_ptr<const void> keep_alive )
+	{
+		auto vertex_size = vertex_count * sizeof( Vertex );
+		auto index_size = index_count * sizeof( uint32_t );
+
+		mesh.vertex_buffer = createDeviceBuffer( vertex_size, vk::BufferUsageFlagBits::eVertexBuffer,
+												 mesh.vertex_allocation );
+		mesh.index_buffer = createDeviceBuffer( index_size, vk::BufferUsageFlagBits::eIndexBuffer,
+												mesh.index_allocation );
+		mesh.index_count = static_cast<uint32_t>( index_count );
+		mesh.pending_uploads = 2;
+
+		auto done = [this, index_count] {
+			if ( !--mesh.pending_uploads ) {
+				cout << "mesh of " << index_count / 3 << " triangles drawable from frame "
+					 << frame_number << endl;
+			}
+		};
+		uploader.uploadBuffer( mesh.vertex_buffer, 0, vertices, vertex_size, done, keep_alive );
+		uploader.uploadBuffer( mesh.index_buffer, 0, indices, index_size, done, keep_alive );
+	}
+
+	// spir-v is consumed straight from the mapping, which is page aligned
+	vk::ShaderModule createShaderModule( const AssetLoad &load )
+	{
+		if ( !load.file ) {
+			throw std::runtime_error( load.error );
+		}
+		auto create_info =
+		  vk::ShaderModuleCreateInfo()
+			.setCodeSize( load.file->size() )
+			.setPCode( reinterpret_cast<const uint32_t *>( load.file->data() ) );
+
+		vk::ShaderModule shader_module;
+		if ( device.createShaderModule( &create_info, nullptr, &shader_module ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to create shader module" );
+		}
+
+		return shader_module;
+	}
+
+	SwapchainSupportDetails querySwapchainSupport( const vk::PhysicalDevice &device )
+	{
+		SwapchainSupportDetails details;
+		details.capabilities = device.getSurfaceCapabilitiesKHR( surface );
+		details.formats = device.getSurfaceFormatsKHR( surface );
+		details.present_modes = device.getSurfacePresentModesKHR( surface );
+		return details;
+	}
+
+	vk::SurfaceFormatKHR chooseSwapSurfaceFormat( const vector<vk::SurfaceFormatKHR> &avail )
+	{
+		for ( auto &avail_format : avail ) {
+			if ( avail_format.format == vk::Format::eB8G8R8A8Unorm &&
+				 avail_format.colorSpace == vk::ColorSpaceKHR::eSrgbNonlinear ) {
+				return avail_format;
+			}
+		}
+		return avail[ 0 ];
+	}
+
+	vk::PresentModeKHR chooseSwapPresentMode( const vector<vk::PresentModeKHR> &avail )
+	{
+		for ( auto &avail_present_mode : avail ) {
+			if ( avail_present_mode == options.present_mode ) {
+				return avail_present_mode;
+			}
+		}
+		cout << vk::to_string( options.present_mode ) << " present mode unsupported, using fifo" << endl;
+		return vk::PresentModeKHR::eFifo;
+	}
+
+	vk::Extent2D chooseSwapExtent( const vk::SurfaceCapabilitiesKHR &capabilities )
+	{
+		if ( capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max() ) {
+			return capabilities.currentExtent;
+		} else {
+			int width, height;
+			glfwGetFramebufferSize( window, &width, &height );
+			vk::Extent2D actual_extent = { static_cast<uint32_t>( width ), static_cast<uint32_t>( height ) };
+			actual_extent.width = std::clamp( actual_extent.width,
+											  capabilities.minImageExtent.width,
+											  capabilities.maxImageExtent.width );
+			actual_extent.height = std::clamp( actual_extent.height,
+											   capabilities.minImageExtent.height,
+											   capabilities.maxImageExtent.height );
+			return actual_extent;
+		}
+	}
+
+	vector<const char *> getRequiredExtensions()
+	{
+		if ( options.headless ) {
+			return {};
+		}
+		uint32_t glfw_ext_cnt = 0;
+		const char **glfw_exts;
+		glfw_exts = glfwGetRequiredInstanceExtensions( &glfw_ext_cnt );
+		vector<const char *> exts( glfw_exts, glfw_exts + glfw_ext_cnt );
+		cout << "required extensions: " << exts.size() << endl;
+		for ( auto &ext : exts ) {
+			cout << ext << endl;
+		}
+		return exts;
+	}
+
+	void drawFrame()
+	{
+		auto record = profiler.beginFrame( frame_number );
+		{
+			ScopedTimer timer( record.stage( ProfileStage::Pace ) );
+			pacer.pace( frame_number );
+		}
+		// input is sampled once pacing lets the frame start
+		if ( window ) {
+			glfwPollEvents();
+		}
+		if ( shader_watcher ) {
+			reloadShaders();
+		}
+		// assets that finished loading queue their uploads for this frame
+		loader.poll();
+
+		{
+			ScopedTimer timer( record.stage( ProfileStage::FrameWait ) );
+			timeline.wait( slot_frames[ current_frame ] );
+		}
+		// the frame that last used this slot is done, its timestamps are ready
+		retireFrameRecord( current_frame );
+		// and so is every frame before it, along with whatever they were using
+		retired[ current_frame ].drain();
+		recording_slot.store( current_frame, std::memory_order_release );
+		if ( !options.capture_path.empty() ) {
+			// never waits: a frame not complete yet is simply checked again next time
+			auto completed = timeline.completed();
+			capture.poll( [completed]( size_t, uint64_t frame ) {
+				return FrameTimeline::value( frame ) <= completed;
+			} );
+		}
+		frame_pool.begin( current_frame );
+		frame_descriptors[ current_frame ].reset();
+		// the whole per frame parameter update: one copy into the slot's region
+		frame_uniform_offset = uniforms.push( frameUniforms() );
+		if ( options.views > 1 ) {
+			view_uniform_offset = uniforms.push( viewUniforms() );
+		}
+		// that frame waited on every upload submitted before it, those have landed for everyone
+		uploader.collect( slot_frames[ current_frame ] );
+
+		// with gpu culling there is no per instance cpu work at all
+		if ( options.cull_mode != CullMode::Gpu ) {
+			ScopedTimer timer( record.stage( ProfileStage::Update ) );
+			auto slice = frame_pool.allocate( instances.size() * sizeof( InstanceData ), alignof( InstanceData ) );
+			instance_offset = slice.offset;
+			auto out = static_cast<InstanceData *>( slice.mapped );
+			if ( options.cull_mode == CullMode::Cpu ) {
+				drawn_instances = instances.cull( cullView(), out );
+			} else {
+				// long stalls (a window drag, a breakpoint) would teleport everything
+				instances.update( static_cast<float>( std::min( record.frame_ms, 100. ) / 1000. ) );
+				instances.write( out );
+				drawn_instances = instances.size();
+			}
+		}
+
+		if ( options.stress ) {
+			// jitter acquire timing so images come back out of frame order
+			this_thread::sleep_for( chrono::microseconds( uniform_int_distribution<int>( 0, 2000 )( stress_rng ) ) );
+		}
+
+		uint32_t image_index;
+		auto acquire_result = vk::Result::eSuccess;
+		{
+			ScopedTimer timer( record.stage( ProfileStage::Acquire ) );
+			if ( options.headless ) {
+				image_index = acquireOffscreenImage();
+			} else {
+				acquire_result = device.acquireNextImageKHR( swap_chain, std::numeric_limits<uint64_t>::max(),
+															 image_avail_semaphores[ current_frame ], vk::Fence{}, &image_index );
+			}
+		}
+		// nothing was submitted on this slot, the timeline is unaffected
+		if ( acquire_result == vk::Result::eErrorOutOfDateKHR ) {
+			recreateSwapchain();
+			return;
+		} else if ( acquire_result != vk::Result::eSuccess && acquire_result != vk::Result::eSuboptimalKHR ) {
+			throw std::runtime_error( "failed to acquire swap chain image" );
+		}
+
+		// an offscreen image can come back before the held back frame composed into it
+		if ( pending_compose && pending_compose->image_index == image_index ) {
+			drainCompose();
+		}
+		waitForImage( image_index, record );
+
+		// only flushed once the frame is certain to be submitted, it must wait on the upload value
+		auto upload = uploader.flush( frame_number );
+		{
+			ScopedTimer timer( record.stage( ProfileStage::Record ) );
+			recordCommandBuffer( current_frame, image_index, upload );
+			if ( options.post_mode == PostMode::Async ) {
+				recordComputeBuffer( current_frame );
+				recordComposeBuffer( current_frame, image_index );
+			}
+		}
+
+		// vertex fetch must not start before the copies on the transfer queue finished
+		vector<vk::Semaphore> render_waits;
+		vector<vk::PipelineStageFlags> render_stages;
+		vector<uint64_t> render_values;
+		if ( upload.semaphore ) {
+			render_waits.emplace_back( upload.semaphore );
+			render_stages.emplace_back( upload.stages );
+			render_values.emplace_back( upload.value );
+		}
+
+		auto present_result = vk::Result::eSuccess;
+		if ( options.post_mode == PostMode::Async ) {
+			{
+				ScopedTimer timer( record.stage( ProfileStage::Submit ) );
+				submitRenderAndPost( render_waits, render_stages, render_values );
+			}
+			// the compose signaling the frame goes out behind the next frame's rendering
+			pacer.submitted( FrameTimeline::value( frame_number ), false );
+			ScopedTimer timer( record.stage( ProfileStage::Present ) );
+			if ( pending_compose ) {
+				present_result = flushCompose();
+			}
+			pending_compose = PendingCompose{ current_frame, image_index, frame_number };
+			// a single slot is recorded again next frame, there is nothing to hold back for
+			if ( options.frames_in_flight == 1 ) {
+				present_result = flushCompose();
+			}
+		} else {
+			{
+				ScopedTimer timer( record.stage( ProfileStage::Submit ) );
+				submitLast( command_buffers[ current_frame ], current_frame, image_index, frame_number,
+							render_waits, render_stages, render_values );
+			}
+			pacer.submitted( FrameTimeline::value( frame_number ) );
+			ScopedTimer timer( record.stage( ProfileStage::Present ) );
+			present_result = present( current_frame, image_index );
+		}
+
+		pending_records[ current_frame ] = record;
+		current_frame = ( current_frame + 1 ) % options.frames_in_flight;
+
+		if ( present_result == vk::Result::eErrorOutOfDateKHR ||
+			 present_result == vk::Result::eSuboptimalKHR || framebuffer_resized ) {
+			recreateSwapchain();
+		} else if ( present_result != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to present swap chain image" );
+		}
+	}
+
+	/* the frame's last submission, the one writing the image: waits for the
+	   image on top of waits, and signals the frame's timeline value and the
+	   slot's semaphore presenting waits on */
+	void submitLast( vk::CommandBuffer command_buffer, size_t slot, uint32_t image_index, uint64_t frame,
+					 vector<vk::Semaphore> waits, vector<vk::PipelineStageFlags> stages, vector<uint64_t> values )
+	{
+		if ( !options.headless ) {
+			waits.emplace_back( image_avail_semaphores[ slot ] );
+			stages.emplace_back( vk::PipelineStageFlagBits::eColorAttachmentOutput );
+			// binary semaphores ignore their value
+			values.emplace_back( 0 );
+		}
+		vk::Semaphore signal_semaphores[] = { timeline.handle(), render_finish_semaphores[ slot ] };
+		uint64_t signal_values[] = { FrameTimeline::value( frame ), 0 };
+		uint32_t signal_count = options.headless ? 1 : 2;
+
+		auto timeline_info =
+		  vk::TimelineSemaphoreSubmitInfo()
+			.setWaitSemaphoreValueCount( values.size() )
+			.setPWaitSemaphoreValues( values.data() )
+			.setSignalSemaphoreValueCount( signal_count )
+			.setPSignalSemaphoreValues( signal_values );
+		auto submit_info =
+		  vk::SubmitInfo()
+			.setPNext( &timeline_info )
+			.setCommandBufferCount( 1 )
+			.setPCommandBuffers( &command_buffer )
+			.setWaitSemaphoreCount( waits.size() )
+			.setPWaitSemaphores( waits.data() )
+			.setPWaitDstStageMask( stages.data() )
+			.setSignalSemaphoreCount( signal_count )
+			.setPSignalSemaphores( signal_semaphores );
+
+		if ( graphics_queue.submit( 1, &submit_info, vk::Fence{} ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to submit draw command buffer" );
+		}
+		slot_frames[ slot ] = FrameTimeline::value( frame );
+		image_frames[ image_index ] = FrameTimeline::value( frame );
+	}
+
+	vk::Result present( size_t slot, uint32_t image_index )
+	{
+		if ( options.headless ) {
+			return vk::Result::eSuccess;
+		}
+		vk::SwapchainKHR swapchains[] = { swap_chain };
+
+		auto present_info =
+		  vk::PresentInfoKHR()
+			.setWaitSemaphoreCount( 1 )
+			.setPWaitSemaphores( &render_finish_semaphores[ slot ] )
+			.setSwapchainCount( 1 )
+			.setPSwapchains( swapchains )
+			.setPImageIndices( &image_index );
+
+		return present_queue.presentKHR( &present_info );
+	}
+
+	/* the last of an async frame's three submissions and its present, held
+	   back until the next frame's rendering is submitted. Queued right
+	   behind its own rendering the compose, which waits on post processing,
+	   would keep the graphics queue from starting on anything else; behind
+	   the next frame's rendering that rendering runs while this frame is
+	   post processed on the compute queue */
+	vk::Result flushCompose()
+	{
+		auto compose = *pending_compose;
+		pending_compose.reset();
+		submitLast( compose_buffers[ compose.slot ], compose.slot, compose.image_index, compose.frame,
+					{ post_ready_semaphores[ compose.slot ] }, { vk::PipelineStageFlagBits::eTransfer }, { 0 } );
+		pacer.signaling( FrameTimeline::value( compose.frame ) );
+		return present( compose.slot, compose.image_index );
+	}
+
+	// a held back frame goes out before the swapchain or the loop does, out of date is no error then
+	void drainCompose()
+	{
+		if ( !pending_compose ) {
+			return;
+		}
+		auto result = flushCompose();
+		if ( result != vk::Result::eSuccess && result != vk::Result::eSuboptimalKHR &&
+			 result != vk::Result::eErrorOutOfDateKHR ) {
+			throw std::runtime_error( "failed to present swap chain image" );
+		}
+	}
+
+	/* the first two of an async frame's three submissions: rendering, then
+	   post processing on the compute queue. Neither waits for the image,
+	   only the compose does, see flushCompose */
+	void submitRenderAndPost( const vector<vk::Semaphore> &render_waits,
+							  const vector<vk::PipelineStageFlags> &render_stages,
+							  const vector<uint64_t> &render_values )
+	{
+		auto timeline_info =
+		  vk::TimelineSemaphoreSubmitInfo()
+			.setWaitSemaphoreValueCount( render_values.size() )
+			.setPWaitSemaphoreValues( render_values.data() );
+		auto render_info =
+		  vk::SubmitInfo()
+			.setPNext( &timeline_info )
+			.setCommandBufferCount( 1 )
+			.setPCommandBuffers( &command_buffers[ current_frame ] )
+			.setWaitSemaphoreCount( render_waits.size() )
+			.setPWaitSemaphores( render_waits.data() )
+			.setPWaitDstStageMask( render_stages.data() )
+			.setSignalSemaphoreCount( 1 )
+			.setPSignalSemaphores( &scene_ready_semaphores[ current_frame ] );
+
+		if ( graphics_queue.submit( 1, &render_info, vk::Fence{} ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to submit draw command buffer" );
+		}
+
+		vk::PipelineStageFlags post_stage = vk::PipelineStageFlagBits::eComputeShader;
+		auto post_info =
+		  vk::SubmitInfo()
+			.setCommandBufferCount( 1 )
+			.setPCommandBuffers( &compute_buffers[ current_frame ] )
+			.setWaitSemaphoreCount( 1 )
+			.setPWaitSemaphores( &scene_ready_semaphores[ current_frame ] )
+			.setPWaitDstStageMask( &post_stage )
+			.setSignalSemaphoreCount( 1 )
+			.setPSignalSemaphores( &post_ready_semaphores[ current_frame ] );
+
+		if ( compute_queue.submit( 1, &post_info, vk::Fence{} ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to submit post processing command buffer" );
+		}
+	}
+
+	// stands in for the presentation engine: round robin, or any image under stress
+	uint32_t acquireOffscreenImage()
+	{
+		auto image_cnt = static_cast<uint32_t>( swap_chain_images.size() );
+		if ( options.stress ) {
+			return uniform_int_distribution<uint32_t>( 0, image_cnt - 1 )( stress_rng );
+		}
+		return next_offscreen_image++ % image_cnt;
+	}
+
+	/* images come back in presentation order, not frame order, so the slot
+	   wait alone does not protect them: wait for whichever frame last
+	   rendered into this image, and only if it is still running */
+	void waitForImage( uint32_t image_index, FrameRecord &record )
+	{
+		auto last = image_frames[ image_index ];
+		if ( last ) {
+			++image_stats.tracked;
+			if ( timeline.completed() < last ) {
+				++image_stats.conflicts;
+				// the slot's own wait, already done, covered slot_frames[ current_frame ] and nothing newer
+				if ( last > slot_frames[ current_frame ] ) {
+					++image_stats.hazards;
+				}
+				ScopedTimer timer( record.stage( ProfileStage::ImageWait ) );
+				timeline.wait( last );
+			}
+			image_stats.wait_ms += record.stage( ProfileStage::ImageWait );
+		}
+	}
+
+	/* defers destroy until no frame recorded before this call can still be
+	   running; callable from any thread. The caller must not record the
+	   resource into any frame after calling this. It lands on the slot being
+	   recorded, whose next wait also covers every earlier frame */
+	void retire( function<void()> destroy )
+	{
+		retired[ recording_slot.load( std::memory_order_acquire ) ].push( std::move( destroy ) );
+	}
+
+	/* for the frame loop's thread between frames, when the slot being
+	   recorded may have completed while others are still in flight: the
+	   newest submitted frame's slot drains only once that frame and every
+	   earlier one are done */
+	void retireBehindNewest( function<void()> destroy )
+	{
+		auto newest = max_element( slot_frames.begin(), slot_frames.end() ) - slot_frames.begin();
+		retired[ newest ].push( std::move( destroy ) );
+	}
+
+	void destroyBuffer( vk::Buffer buffer, const Allocation &allocation )
+	{
+		device.destroy( buffer );
+		allocator.free( allocation );
+	}
+
+	// once every slot has retired, oldest pending frame first
+	void retireFrameRecords()
+	{
+		for ( size_t i = 0; i < options.frames_in_flight; ++i ) {
+			retireFrameRecord( ( current_frame + i ) % options.frames_in_flight );
+		}
+	}
+
+	// completes the record of the frame last submitted on a slot that has completed
+	void retireFrameRecord( size_t slot )
+	{
+		auto &record = pending_records[ slot ];
+		if ( !record.has_value() ) {
+			return;
+		}
+		if ( query_pool ) {
+			uint64_t timestamps[ 2 ];
+			if ( device.getQueryPoolResults( query_pool, 2 * slot, 2,
+											 sizeof( timestamps ), timestamps, sizeof( uint64_t ),
+											 vk::QueryResultFlagBits::e64 ) == vk::Result::eSuccess ) {
+				auto ticks = ( timestamps[ 1 ] - timestamps[ 0 ] ) & timestamp_mask;
+				record->gpu_ms = ticks * timestamp_period / 1e6;
+				pacer.gpuTime( record->gpu_ms );
+			}
+		}
+		profiler.push( *record );
+		record.reset();
+	}
+
+private:
+	Options options;
+	AssetLoader loader;
+	shared_ptr<AssetLoad> vert_shader_load;
+	shared_ptr<AssetLoad> frag_shader_load;
+	shared_ptr<AssetLoad> pipeline_cache_load;
+	shared_ptr<AssetLoad> mesh_load;
+	GLFWwindow *window = nullptr;
+	vk::Instance inst;
+	vk::SurfaceKHR surface;
+	vk::PhysicalDevice physical_device;
+	vk::Device device;
+	MemoryAllocator allocator;
+	LinearPool frame_pool;
+	DescriptorAllocator static_descriptors;
+	// transient sets, reset with the slot
+	vector<DescriptorAllocator> frame_descriptors;
+	UniformRing uniforms;
+	vk::DescriptorSet frame_set;
+	// where this frame's FrameUniforms landed in the ring
+	uint32_t frame_uniform_offset = 0;
+	vk::Queue graphics_queue;
+	vk::Queue present_queue;
+	vk::Queue transfer_queue;
+	// the graphics queue itself when there is no separate compute family
+	vk::Queue compute_queue;
+	Uploader uploader;
+	Mesh mesh;
+	InstanceStore instances;
+	// gpu culling: one per frame slot, rewritten by the culling pass each frame
+	vector<vk::Buffer> instance_buffers;
+	vector<Allocation> instance_allocations;
+	// otherwise where this frame's instances landed in the frame pool
+	vk::DeviceSize instance_offset = 0;
+	uint32_t drawn_instances = 0;
+	// gpu culling: the static world, and an indirect draw per frame slot
+	shared_ptr<AssetLoad> cull_shader_load;
+	unique_ptr<FileWatcher> shader_watcher;
+	// in progress reloads by file name
+	map<string, shared_ptr<AssetLoad>> shader_reloads;
+	vk::DescriptorSetLayout cull_set_layout;
+	vk::PipelineLayout cull_pipeline_layout;
+	vk::Pipeline cull_pipeline;
+	vector<vk::DescriptorSet> cull_sets;
+	shared_ptr<AssetLoad> post_shader_load;
+	vk::DescriptorSetLayout post_set_layout;
+	vk::PipelineLayout post_pipeline_layout;
+	vk::Pipeline post_pipeline;
+	vk::Sampler post_sampler;
+	// per frame slot with async post processing, recreated with the swapchain
+	struct SceneTarget
+	{
+		vk::Image scene;
+		Allocation scene_allocation;
+		vk::ImageView scene_view;
+		vk::Framebuffer frame_buffer;
+		vk::Image post;
+		Allocation post_allocation;
+		vk::ImageView post_view;
+	};
+	vector<SceneTarget> scene_targets;
+	// over the frame graph's transients, recreated with them
+	vk::Framebuffer scene_frame_buffer;
+	// without multiview a view per layer, each with its framebuffer
+	vector<vk::ImageView> view_layers;
+	vector<vk::Framebuffer> view_frame_buffers;
+	vk::Extent2D view_extent;
+	uint32_t view_columns = 1;
+	vk::DescriptorSetLayout view_set_layout;
+	vk::DescriptorSet view_set;
+	uint32_t view_uniform_offset = 0;
+	vk::Buffer object_buffer;
+	Allocation object_allocation;
+	bool objects_ready = false;
+	vector<vk::Buffer> indirect_buffers;
+	vector<Allocation> indirect_allocations;
+	RenderGraph frame_graph;
+	// async post processing: what runs after the compute queue, in its own submission
+	RenderGraph compose_graph;
+	RenderGraph::ResourceId graph_target = 0;
+	RenderGraph::ResourceId graph_scene = 0;
+	RenderGraph::ResourceId graph_post = 0;
+	RenderGraph::ResourceId graph_views = 0;
+	RenderGraph::ResourceId graph_instances = 0;
+	RenderGraph::ResourceId graph_objects = 0;
+	RenderGraph::ResourceId graph_indirect = 0;
+	RenderGraph::ResourceId graph_capture = 0;
+	FrameCapture capture;
+	// what the frame being recorded copies into, null when it is dropped
+	vk::Buffer capture_buffer;
+	vk::SwapchainKHR swap_chain;
+	vk::PresentModeKHR present_mode = vk::PresentModeKHR::eFifo;
+	vector<vk::Image> swap_chain_images;
+	vector<Allocation> offscreen_allocations;
+	vk::Format swap_chain_image_format;
+	vk::Extent2D swap_chain_extent;
+	vector<vk::ImageView> swap_chain_image_views;
+	vk::RenderPass render_pass;
+	// multiview: broadcasts every draw to all views
+	vk::RenderPass views_render_pass;
+	vk::PipelineCache pipeline_cache;
+	bool pipeline_cache_hit = false;
+	vk::DescriptorSetLayout frame_set_layout;
+	vk::PipelineLayout pipeline_layout;
+	PipelineManager pipelines;
+	// owned by the manager, the fallback for every variant
+	vk::Pipeline graphics_pipeline;
+	// manager key graphics_pipeline follows once it is compiled
+	uint64_t base_pipeline = 0;
+	// manager keys, and what they resolved to for the frame being recorded
+	vector<uint64_t> pipeline_variants;
+	vector<vk::Pipeline> variant_pipelines;
+	// a shader reload's keys until promoteReload swaps them in or drops them, 0 without one
+	uint64_t reload_base = 0;
+	vector<uint64_t> reload_variants;
+	// and the shaders they were built from, null for a stage not reloaded
+	shared_ptr<AssetLoad> reload_vert;
+	shared_ptr<AssetLoad> reload_frag;
+	vector<vk::Framebuffer> swap_chain_frame_buffers;
+	// one pool and one primary command buffer per frame slot
+	vector<vk::CommandPool> command_pools;
+	vector<vk::CommandBuffer> command_buffers;
+	// async post processing: the slot's compute work, and the compose submission after it
+	vector<vk::CommandPool> compute_pools;
+	vector<vk::CommandBuffer> compute_buffers;
+	vector<vk::CommandBuffer> compose_buffers;
+	// secondary recording, indexed [ worker ][ slot ]
+	unique_ptr<WorkerPool> workers;
+	vector<vector<vk::CommandPool>> worker_pools;
+	vector<vector<vk::CommandBuffer>> secondary_buffers;
+	vector<vk::Semaphore> image_avail_semaphores;
+	vector<vk::Semaphore> render_finish_semaphores;
+	// async post processing: rendering to compute, compute to compose
+	vector<vk::Semaphore> scene_ready_semaphores;
+	vector<vk::Semaphore> post_ready_semaphores;
+	// the async frame whose compose and present wait for the next frame's rendering
+	struct PendingCompose
+	{
+		size_t slot;
+		uint32_t image_index;
+		uint64_t frame;
+	};
+	optional<PendingCompose> pending_compose;
+	// counts completed frames, what every wait for a frame waits on
+	FrameTimeline timeline;
+	FramePacer pacer;
+	// destructors per slot, run once the slot's frame has completed again
+	deque<DeletionQueue> retired;
+	atomic<size_t> recording_slot{ 0 };
+	vk::QueryPool query_pool;
+	float timestamp_period = 0;
+	uint64_t timestamp_mask = 0;
+	Profiler profiler;
+	vector<optional<FrameRecord>> pending_records;
+	// timeline value of the frame last submitted per slot / per image, 0 when unused
+	vector<uint64_t> slot_frames;
+	vector<uint64_t> image_frames;
+	ImageTrackingStats image_stats;
+	uint32_t next_offscreen_image = 0;
+	mt19937 stress_rng{ 5489u };
+	bool framebuffer_resized = false;
+	vk::Extent2D base_extent;
+	bool resize_toggle = false;
+	vector<double> recreate_times;
+	uint32_t pipeline_rebuilds = 0;
+
+	size_t current_frame = 0;
+	uint64_t frame_number = 0;
+	chrono::steady_clock::time_point run_start;
+	vector<pair<string, double>> startup_phases;
+};
+
+inline vk::PresentModeKHR parsePresentMode( const string &name )
+{
+	if ( name == "immediate" ) return vk::PresentModeKHR::eImmediate;
+	if ( name == "mailbox" ) return vk::PresentModeKHR::eMailbox;
+	if ( name == "fifo" ) return vk::PresentModeKHR::eFifo;
+	if ( name == "fifo_relaxed" ) return vk::PresentModeKHR::eFifoRelaxed;
+	throw std::runtime_error( "unknown present mode: " + name );
+}
+
+inline CullMode parseCullMode( const string &name )
+{
+	if ( name == "none" ) return CullMode::None;
+	if ( name == "cpu" ) return CullMode::Cpu;
+	if ( name == "gpu" ) return CullMode::Gpu;
+	throw std::runtime_error( "unknown cull mode: " + name );
+}
+
+inline const char *cullModeName( CullMode mode )
+{
+	static const char *names[] = { "none", "cpu", "gpu" };
+	return names[ static_cast<int>( mode ) ];
+}
+
+inline PostMode parsePostMode( const string &name )
+{
+	if ( name == "off" ) return PostMode::Off;
+	if ( name == "serial" ) return PostMode::Serial;
+	if ( name == "async" ) return PostMode::Async;
+	throw std::runtime_error( "unknown post processing mode: " + name );
+}
+
+inline const char *postModeName( PostMode mode )
+{
+	static const char *names[] = { "off", "serial", "async" };
+	return names[ static_cast<int>( mode ) ];
+}
+
+inline ViewMode parseViewMode( const string &name )
+{
+	if ( name == "multiview" ) return ViewMode::Multiview;
+	if ( name == "sequential" ) return ViewMode::Sequential;
+	throw std::runtime_error( "unknown view mode: " + name );
+}
+
+inline const char *viewModeName( ViewMode mode )
+{
+	static const char *names[] = { "multiview", "sequential" };
+	return names[ static_cast<int>( mode ) ];
+}
+
+inline bool parseOption( Options &options, int &i, int argc, char **argv );
+
+// the options that take no value, or null
+inline bool *switchOption( Options &options, const string &arg )
+{
+	if ( arg == "--stress" ) return &options.stress;
+	if ( arg == "--device-bench" ) return &options.device_bench;
+	if ( arg == "--low-latency" ) return &options.low_latency;
+	if ( arg == "--watch-shaders" ) return &options.watch_shaders;
+	return nullptr;
+}
+
+inline bool parseSwitch( const string &key, const string &value )
+{
+	if ( value == "true" || value == "1" ) return true;
+	if ( value == "false" || value == "0" ) return false;
+	throw std::runtime_error( "invalid value for " + key + ", expected true or false: " + value );
+}
+
+/* `key = value` lines, keys are the long option names without dashes,
+   e.g. `present-mode = fifo`; '#' starts a comment. A switch such as
+   `stress` stands on its own or takes `true`/`false` (or 1/0) */
+inline void loadConfigFile( Options &options, const string &file_name )
+{
+	ifstream is( file_name );
+	if ( !is.is_open() ) {
+		throw std::runtime_error( "failed to open config file" );
+	}
+	auto trim = []( const string &str ) {
+		auto begin = str.find_first_not_of( " \t\r" );
+		auto end = str.find_last_not_of( " \t\r" );
+		return begin == string::npos ? string() : str.substr( begin, end - begin + 1 );
+	};
+	string line;
+	while ( getline( is, line ) ) {
+		line = trim( line.substr( 0, line.find( '#' ) ) );
+		if ( line.empty() ) {
+			continue;
+		}
+		auto eq = line.find( '=' );
+		auto key = "--" + trim( line.substr( 0, eq ) );
+		if ( auto flag = switchOption( options, key ) ) {
+			*flag = eq == string::npos || parseSwitch( key.substr( 2 ), trim( line.substr( eq + 1 ) ) );
+			continue;
+		}
+		if ( eq == string::npos ) {
+			throw std::runtime_error( "invalid config line: " + line );
+		}
+		// feed the pair through the command line parser so both stay in sync
+		auto value = trim( line.substr( eq + 1 ) );
+		char *args[] = { &key[ 0 ], &value[ 0 ] };
+		int idx = 0;
+		if ( !parseOption( options, idx, 2, args ) ) {
+			throw std::runtime_error( "unknown config key: " + key.substr( 2 ) );
+		}
+	}
+}
+
+// consumes argv[ i ] (and its value) if it is an application option
+inline bool parseOption( Options &options, int &i, int argc, char **argv )
+{
+	string arg = argv[ i ];
+	if ( arg == "--headless" && i + 1 < argc ) {
+		options.headless = true;
+		if ( sscanf( argv[ ++i ], "%ux%u", &options.width, &options.height ) != 2 ||
+			 !options.width || !options.height ) {
+			throw std::runtime_error( "invalid --headless extent, expected WxH" );
+		}
+	} else if ( arg == "--frames" && i + 1 < argc ) {
+		options.frame_count = stoull( argv[ ++i ] );
+	} else if ( arg == "--duration" && i + 1 < argc ) {
+		options.duration = stod( argv[ ++i ] );
+	} else if ( arg == "--draws" && i + 1 < argc ) {
+		options.draw_count = stoul( argv[ ++i ] );
+	} else if ( arg == "--profile-dump" && i + 1 < argc ) {
+		options.profile_dump = argv[ ++i ];
+	} else if ( arg == "--threads" && i + 1 < argc ) {
+		options.record_threads = stoul( argv[ ++i ] );
+	} else if ( arg == "--frames-in-flight" && i + 1 < argc ) {
+		options.frames_in_flight = stoul( argv[ ++i ] );
+	} else if ( arg == "--swapchain-images" && i + 1 < argc ) {
+		options.swapchain_images = stoul( argv[ ++i ] );
+	} else if ( arg == "--present-mode" && i + 1 < argc ) {
+		options.present_mode = parsePresentMode( argv[ ++i ] );
+	} else if ( arg == "--resize-every" && i + 1 < argc ) {
+		options.resize_every = stoul( argv[ ++i ] );
+	} else if ( arg == "--mesh-triangles" && i + 1 < argc ) {
+		options.mesh_triangles = stoul( argv[ ++i ] );
+	} else if ( arg == "--instances" && i + 1 < argc ) {
+		options.instance_count = stoul( argv[ ++i ] );
+	} else if ( arg == "--cull" && i + 1 < argc ) {
+		options.cull_mode = parseCullMode( argv[ ++i ] );
+	} else if ( arg == "--mesh-file" && i + 1 < argc ) {
+		options.mesh_file = argv[ ++i ];
+	} else if ( arg == "--io-threads" && i + 1 < argc ) {
+		options.io_threads = stoul( argv[ ++i ] );
+	} else if ( arg == "--variants" && i + 1 < argc ) {
+		options.pipeline_variants = stoul( argv[ ++i ] );
+	} else if ( arg == "--views" && i + 1 < argc ) {
+		options.views = stoul( argv[ ++i ] );
+	} else if ( arg == "--view-mode" && i + 1 < argc ) {
+		options.view_mode = parseViewMode( argv[ ++i ] );
+	} else if ( arg == "--device" && i + 1 < argc ) {
+		options.device = argv[ ++i ];
+	} else if ( arg == "--post" && i + 1 < argc ) {
+		options.post_mode = parsePostMode( argv[ ++i ] );
+	} else if ( arg == "--max-fps" && i + 1 < argc ) {
+		options.max_fps = stod( argv[ ++i ] );
+	} else if ( arg == "--target-latency" && i + 1 < argc ) {
+		options.target_latency_ms = stod( argv[ ++i ] );
+	} else if ( arg == "--capture" && i + 1 < argc ) {
+		options.capture_path = argv[ ++i ];
+	} else if ( arg == "--capture-format" && i + 1 < argc ) {
+		options.capture_format = parseCaptureFormat( argv[ ++i ] );
+	} else if ( arg == "--capture-buffers" && i + 1 < argc ) {
+		options.capture_buffers = stoul( argv[ ++i ] );
+	} else if ( arg == "--config" && i + 1 < argc ) {
+		loadConfigFile( options, argv[ ++i ] );
+	} else if ( auto flag = switchOption( options, arg ) ) {
+		*flag = true;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+inline void finalizeOptions( Options &options )
+{
+	if ( !options.frames_in_flight ) {
+		throw std::runtime_error( "at least one frame in flight is required" );
+	}
+	if ( !options.mesh_triangles ) {
+		throw std::runtime_error( "the mesh needs at least one triangle" );
+	}
+	if ( !options.instance_count ) {
+		throw std::runtime_error( "at least one instance is required" );
+	}
+	if ( !options.io_threads ) {
+		throw std::runtime_error( "at least one i/o thread is required" );
+	}
+	if ( !options.pipeline_variants ) {
+		throw std::runtime_error( "at least one pipeline variant is required" );
+	}
+	if ( !options.capture_buffers ) {
+		throw std::runtime_error( "capture needs at least one readback buffer" );
+	}
+	if ( !options.views || options.views > ViewUniforms::MAX_VIEWS ) {
+		throw std::runtime_error( "between 1 and " + to_string( ViewUniforms::MAX_VIEWS ) + " views are supported" );
+	}
+	// a secondary is recorded once per frame, for one framebuffer and one view
+	if ( options.views > 1 && options.view_mode == ViewMode::Sequential && options.record_threads ) {
+		throw std::runtime_error( "sequential views are recorded on the render thread, drop --threads" );
+	}
+	if ( options.max_fps < 0 || options.target_latency_ms < 0 ) {
+		throw std::runtime_error( "frame rate cap and target latency cannot be negative" );
+	}
+	// a headless run has no window to close
+	if ( options.headless && !options.frame_count && options.duration <= 0 ) {
+		options.frame_count = 1000;
+	}
+}
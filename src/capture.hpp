@@ -0,0 +1,534 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <vulkan/vulkan.hpp>
+
+#include "memory.hpp"
+
+enum class CaptureFormat
+{
+	// one file of tightly packed pixels per frame, in the target's byte order
+	Raw,
+	// one rgba png per frame
+	Png,
+	// every frame appended to a single memory mapped file
+	Container
+};
+
+inline CaptureFormat parseCaptureFormat( const std::string &name )
+{
+	if ( name == "raw" ) return CaptureFormat::Raw;
+	if ( name == "png" ) return CaptureFormat::Png;
+	if ( name == "container" ) return CaptureFormat::Container;
+	throw std::runtime_error( "unknown capture format: " + name );
+}
+
+inline const char *captureFormatName( CaptureFormat format )
+{
+	static const char *names[] = { "raw", "png", "container" };
+	return names[ static_cast<int>( format ) ];
+}
+
+// one frame sitting in a readback buffer, 4 bytes per pixel
+struct CaptureImage
+{
+	uint64_t frame = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	// blue first, swizzled for png
+	bool bgra = false;
+	const char *pixels = nullptr;
+};
+
+/* the container is a header followed by records of a frame header and its
+   pixels; frame_count is only final once the capture has finished */
+struct CaptureFileHeader
+{
+	char magic[ 4 ];
+	uint32_t version;
+	uint64_t frame_count;
+};
+
+struct CaptureFrameHeader
+{
+	uint64_t frame;
+	uint32_t width;
+	uint32_t height;
+	// 0 rgba, 1 bgra
+	uint32_t order;
+	uint32_t reserved;
+};
+
+inline constexpr char CAPTURE_FILE_MAGIC[ 4 ] = { 'C', 'A', 'P', 'T' };
+
+/* png with stored (uncompressed) deflate blocks: no compression library,
+   and the cost is dominated by two checksums over the pixels */
+struct PngEncoder
+{
+	PngEncoder()
+	{
+		for ( uint32_t n = 0; n < 256; ++n ) {
+			auto c = n;
+			for ( int k = 0; k < 8; ++k ) {
+				c = c & 1 ? 0xedb88320u ^ ( c >> 1 ) : c >> 1;
+			}
+			crc_table[ n ] = c;
+		}
+	}
+
+	const std::vector<char> &encode( const CaptureImage &image )
+	{
+		// filter byte 0 (none) in front of every row
+		auto row_size = size_t( image.width ) * 4 + 1;
+		scanlines.resize( row_size * image.height );
+		for ( uint32_t y = 0; y < image.height; ++y ) {
+			auto dst = &scanlines[ y * row_size ];
+			auto src = image.pixels + size_t( y ) * image.width * 4;
+			dst[ 0 ] = 0;
+			memcpy( dst + 1, src, size_t( image.width ) * 4 );
+			if ( image.bgra ) {
+				for ( uint32_t x = 0; x < image.width; ++x ) {
+					std::swap( dst[ 1 + 4 * x ], dst[ 3 + 4 * x ] );
+				}
+			}
+		}
+
+		out.clear();
+		static const char signature[] = { char( 0x89 ), 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+		out.insert( out.end(), signature, signature + 8 );
+
+		char header[ 13 ];
+		putBE( header, image.width );
+		putBE( header + 4, image.height );
+		// 8 bits per channel, rgba, deflate, adaptive filtering, no interlace
+		header[ 8 ] = 8;
+		header[ 9 ] = 6;
+		header[ 10 ] = header[ 11 ] = header[ 12 ] = 0;
+		chunk( "IHDR", header, sizeof( header ) );
+
+		// zlib stream: header, stored blocks of at most 65535 bytes, adler32
+		zlib.clear();
+		zlib.push_back( 0x78 );
+		zlib.push_back( 0x01 );
+		size_t offset = 0;
+		do {
+			auto length = std::min<size_t>( scanlines.size() - offset, 65535 );
+			zlib.push_back( offset + length == scanlines.size() ? 1 : 0 );
+			zlib.push_back( char( length & 0xff ) );
+			zlib.push_back( char( length >> 8 ) );
+			zlib.push_back( char( ~length & 0xff ) );
+			zlib.push_back( char( ( ~length >> 8 ) & 0xff ) );
+			zlib.insert( zlib.end(), scanlines.begin() + offset, scanlines.begin() + offset + length );
+			offset += length;
+		} while ( offset < scanlines.size() );
+		char adler[ 4 ];
+		putBE( adler, adler32( scanlines.data(), scanlines.size() ) );
+		zlib.insert( zlib.end(), adler, adler + 4 );
+		chunk( "IDAT", zlib.data(), zlib.size() );
+
+		chunk( "IEND", nullptr, 0 );
+		return out;
+	}
+
+private:
+	static void putBE( char *dst, uint32_t value )
+	{
+		dst[ 0 ] = char( value >> 24 );
+		dst[ 1 ] = char( value >> 16 );
+		dst[ 2 ] = char( value >> 8 );
+		dst[ 3 ] = char( value );
+	}
+
+	static uint32_t adler32( const char *data, size_t size )
+	{
+		uint32_t a = 1, b = 0;
+		while ( size ) {
+			// the largest run that cannot overflow before the modulo
+			auto run = std::min<size_t>( size, 5552 );
+			size -= run;
+			while ( run-- ) {
+				a += static_cast<unsigned char>( *data++ );
+				b += a;
+			}
+			a %= 65521;
+			b %= 65521;
+		}
+		return b << 16 | a;
+	}
+
+	void chunk( const char *type, const char *data, size_t size )
+	{
+		char length[ 4 ];
+		putBE( length, static_cast<uint32_t>( size ) );
+		out.insert( out.end(), length, length + 4 );
+		auto start = out.size();
+		out.insert( out.end(), type, type + 4 );
+		if ( size ) {
+			out.insert( out.end(), data, data + size );
+		}
+		uint32_t crc = ~0u;
+		for ( auto i = start; i < out.size(); ++i ) {
+			crc = crc_table[ ( crc ^ static_cast<unsigned char>( out[ i ] ) ) & 0xff ] ^ ( crc >> 8 );
+		}
+		char checksum[ 4 ];
+		putBE( checksum, ~crc );
+		out.insert( out.end(), checksum, checksum + 4 );
+	}
+
+private:
+	uint32_t crc_table[ 256 ];
+	std::vector<char> scanlines;
+	std::vector<char> zlib;
+	std::vector<char> out;
+};
+
+struct CaptureStats
+{
+	// frames copied off the gpu and written out
+	uint64_t captured = 0;
+	// frames skipped because every readback buffer was busy
+	uint64_t dropped = 0;
+	// frames read back but lost to a failed write
+	uint64_t failed = 0;
+	uint64_t bytes_written = 0;
+	// time the writer thread spent per frame
+	double write_ms = 0;
+};
+
+/* reads frames back without ever stalling the frame loop. Each captured
+   frame copies its target into a free host visible buffer of the ring;
+   poll() finds the copies whose frame has retired and hands them to the
+   writer thread, which gives the buffer back once it is on disk. When the
+   writer falls behind and no buffer is free the frame is dropped, counted,
+   and rendering carries on */
+struct FrameCapture
+{
+	void init( vk::Device device, MemoryAllocator &allocator, vk::MemoryPropertyFlags properties,
+			   CaptureFormat format, const std::string &path, uint32_t buffer_count )
+	{
+		this->device = device;
+		this->properties = properties;
+		this->format = format;
+		this->path = path;
+		buffers.resize( buffer_count );
+		createBuffer( allocator, drop_buffer, 4 );
+		if ( format == CaptureFormat::Container ) {
+			openContainer();
+		}
+		writer = std::thread( [this] { writeLoop(); } );
+	}
+
+	/* picks the buffer this frame copies into, null when all are busy;
+	   buffers are grown here, while nothing is using them: a buffer is only
+	   free once the frame that copied into it has retired, and dropped
+	   frames never reference one */
+	vk::Buffer begin( MemoryAllocator &allocator, uint64_t frame, size_t slot, vk::Extent2D extent, bool bgra )
+	{
+		reclaim();
+		for ( auto &buffer : buffers ) {
+			if ( buffer.state != State::Free ) {
+				continue;
+			}
+			auto size = vk::DeviceSize( extent.width ) * extent.height * 4;
+			if ( buffer.size < size ) {
+				releaseBuffer( allocator, buffer );
+				createBuffer( allocator, buffer, size );
+			}
+			buffer.state = State::Copying;
+			buffer.image = CaptureImage{ frame, extent.width, extent.height, bgra,
+										 static_cast<const char *>( buffer.allocation.mapped ) };
+			buffer.slot = slot;
+			copying.emplace_back( &buffer - buffers.data() );
+			return buffer.buffer;
+		}
+		++stats.dropped;
+		return vk::Buffer{};
+	}
+
+	// never copied into nor resized, for binding where a dropped frame copies nothing
+	vk::Buffer dropBuffer() const { return drop_buffer.buffer; }
+
+	// hands every copy whose frame retired( slot, frame ) to the writer, oldest first
+	void poll( const std::function<bool( size_t, uint64_t )> &retired )
+	{
+		while ( !copying.empty() ) {
+			auto &buffer = buffers[ copying.front() ];
+			if ( !retired( buffer.slot, buffer.image.frame ) ) {
+				break;
+			}
+			buffer.state = State::Writing;
+			{
+				std::lock_guard<std::mutex> lock( mutex );
+				queue.emplace_back( copying.front() );
+			}
+			work_cv.notify_one();
+			copying.pop_front();
+		}
+	}
+
+	/* once the gpu is idle: writes out everything still pending, stops the
+	   writer and completes the container */
+	void finish()
+	{
+		if ( !writer.joinable() ) {
+			return;
+		}
+		poll( []( size_t, uint64_t ) { return true; } );
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			stopping = true;
+		}
+		work_cv.notify_all();
+		writer.join();
+		reclaim();
+		closeContainer();
+	}
+
+	CaptureStats getStats() const
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		auto result = stats;
+		result.captured = written_frames;
+		result.failed = failed_frames;
+		result.bytes_written = written_bytes;
+		result.write_ms = written_frames ? write_ms / written_frames : 0.;
+		return result;
+	}
+
+	void destroy( MemoryAllocator &allocator )
+	{
+		finish();
+		for ( auto &buffer : buffers ) {
+			releaseBuffer( allocator, buffer );
+		}
+		buffers.clear();
+		releaseBuffer( allocator, drop_buffer );
+	}
+
+private:
+	enum class State
+	{
+		Free,
+		// the frame's copy may still be running on the gpu
+		Copying,
+		// owned by the writer thread
+		Writing
+	};
+
+	struct Readback
+	{
+		vk::Buffer buffer;
+		Allocation allocation;
+		vk::DeviceSize size = 0;
+		State state = State::Free;
+		size_t slot = 0;
+		CaptureImage image;
+	};
+
+	void createBuffer( MemoryAllocator &allocator, Readback &buffer, vk::DeviceSize size )
+	{
+		auto buffer_info =
+		  vk::BufferCreateInfo()
+			.setSize( size )
+			.setUsage( vk::BufferUsageFlagBits::eTransferDst )
+			.setSharingMode( vk::SharingMode::eExclusive );
+
+		if ( device.createBuffer( &buffer_info, nullptr, &buffer.buffer ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to create readback buffer" );
+		}
+		buffer.allocation = allocator.allocateBuffer( buffer.buffer, properties );
+		buffer.size = size;
+	}
+
+	void releaseBuffer( MemoryAllocator &allocator, Readback &buffer )
+	{
+		device.destroy( buffer.buffer );
+		allocator.free( buffer.allocation );
+		buffer = Readback{};
+	}
+
+	// buffers the writer is done with become free again
+	void reclaim()
+	{
+		std::vector<size_t> done;
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			done.swap( written );
+		}
+		for ( auto index : done ) {
+			buffers[ index ].state = State::Free;
+		}
+	}
+
+	void writeLoop()
+	{
+		PngEncoder png;
+		while ( true ) {
+			size_t index;
+			{
+				std::unique_lock<std::mutex> lock( mutex );
+				work_cv.wait( lock, [this] { return stopping || !queue.empty(); } );
+				if ( queue.empty() ) {
+					return;
+				}
+				index = queue.front();
+				queue.pop_front();
+			}
+
+			auto start = std::chrono::steady_clock::now();
+			size_t bytes = 0;
+			auto ok = true;
+			try {
+				bytes = write( buffers[ index ].image, png );
+			} catch ( const std::exception &e ) {
+				// a full disk loses frames, not the run
+				std::cerr << "capture: " << e.what() << std::endl;
+				ok = false;
+			}
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+			std::lock_guard<std::mutex> lock( mutex );
+			written.emplace_back( index );
+			if ( !ok ) {
+				++failed_frames;
+				continue;
+			}
+			++written_frames;
+			written_bytes += bytes;
+			write_ms += elapsed.count();
+		}
+	}
+
+	size_t write( const CaptureImage &image, PngEncoder &png )
+	{
+		auto size = size_t( image.width ) * image.height * 4;
+		if ( format == CaptureFormat::Container ) {
+			CaptureFrameHeader header{ image.frame, image.width, image.height, image.bgra ? 1u : 0u, 0 };
+			auto record = reserveContainer( sizeof( header ) + size );
+			memcpy( record, &header, sizeof( header ) );
+			memcpy( record + sizeof( header ), image.pixels, size );
+			++container_frames;
+			return sizeof( header ) + size;
+		}
+
+		char name[ 32 ];
+		snprintf( name, sizeof( name ), "/frame_%06llu.%s", static_cast<unsigned long long>( image.frame ),
+				  format == CaptureFormat::Png ? "png" : "raw" );
+		auto file = fopen( ( path + name ).c_str(), "wb" );
+		if ( !file ) {
+			throw std::runtime_error( "failed to open capture file in " + path );
+		}
+		const char *data = image.pixels;
+		if ( format == CaptureFormat::Png ) {
+			auto &encoded = png.encode( image );
+			data = encoded.data();
+			size = encoded.size();
+		}
+		auto ok = fwrite( data, 1, size, file ) == size;
+		fclose( file );
+		if ( !ok ) {
+			throw std::runtime_error( "failed to write capture file in " + path );
+		}
+		return size;
+	}
+
+	void openContainer()
+	{
+		fd = open( path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+		if ( fd < 0 ) {
+			throw std::runtime_error( "failed to create capture file " + path );
+		}
+		container_size = sizeof( CaptureFileHeader );
+		mapContainer( 64ull << 20 );
+		CaptureFileHeader header{};
+		memcpy( header.magic, CAPTURE_FILE_MAGIC, 4 );
+		header.version = 1;
+		memcpy( mapped, &header, sizeof( header ) );
+	}
+
+	// grows the file and the mapping to at least capacity bytes
+	void mapContainer( size_t capacity )
+	{
+		if ( ftruncate( fd, capacity ) != 0 ) {
+			throw std::runtime_error( "failed to grow capture file " + path );
+		}
+		auto addr = mapped ? mremap( mapped, mapped_size, capacity, MREMAP_MAYMOVE )
+						   : mmap( nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+		if ( addr == MAP_FAILED ) {
+			throw std::runtime_error( "failed to map capture file " + path );
+		}
+		mapped = static_cast<char *>( addr );
+		mapped_size = capacity;
+	}
+
+	char *reserveContainer( size_t size )
+	{
+		if ( container_size + size > mapped_size ) {
+			mapContainer( std::max( mapped_size * 2, container_size + size ) );
+		}
+		auto record = mapped + container_size;
+		container_size += size;
+		return record;
+	}
+
+	void closeContainer()
+	{
+		if ( fd < 0 ) {
+			return;
+		}
+		reinterpret_cast<CaptureFileHeader *>( mapped )->frame_count = container_frames;
+		munmap( mapped, mapped_size );
+		// drop the unused tail of the last growth step
+		if ( ftruncate( fd, container_size ) != 0 ) {
+			perror( "capture file" );
+		}
+		close( fd );
+		fd = -1;
+		mapped = nullptr;
+	}
+
+private:
+	vk::Device device;
+	vk::MemoryPropertyFlags properties;
+	CaptureFormat format = CaptureFormat::Raw;
+	std::string path;
+	std::vector<Readback> buffers;
+	Readback drop_buffer;
+	// buffer indices in frame order
+	std::deque<size_t> copying;
+
+	std::thread writer;
+	mutable std::mutex mutex;
+	std::condition_variable work_cv;
+	std::deque<size_t> queue;
+	std::vector<size_t> written;
+	bool stopping = false;
+	CaptureStats stats;
+	uint64_t written_frames = 0;
+	uint64_t failed_frames = 0;
+	uint64_t written_bytes = 0;
+	double write_ms = 0;
+
+	int fd = -1;
+	char *mapped = nullptr;
+	size_t mapped_size = 0;
+	size_t container_size = 0;
+	uint64_t container_frames = 0;
+};
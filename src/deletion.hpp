@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <utility>
+
+/* destructors waiting for a frame slot to complete. push() is lock-free and may
+   be called from any thread; drain() takes the whole list with a single
+   exchange and runs it on the calling thread, oldest first. Since nothing
+   is ever popped one by one, the stack has no ABA problem */
+struct DeletionQueue
+{
+	DeletionQueue() = default;
+	~DeletionQueue()
+	{
+		// whatever is left was never run, the owner drains before shutdown
+		auto node = head.exchange( nullptr, std::memory_order_acquire );
+		while ( node ) {
+			auto next = node->next;
+			delete node;
+			node = next;
+		}
+	}
+
+	DeletionQueue( const DeletionQueue & ) = delete;
+	DeletionQueue &operator=( const DeletionQueue & ) = delete;
+
+	void push( std::function<void()> destroy )
+	{
+		auto node = new Node{ std::move( destroy ), head.load( std::memory_order_relaxed ) };
+		while ( !head.compare_exchange_weak( node->next, node,
+											 std::memory_order_release, std::memory_order_relaxed ) ) {
+		}
+	}
+
+	// runs every destructor pushed so far, in push order, and returns how many
+	size_t drain()
+	{
+		auto node = head.exchange( nullptr, std::memory_order_acquire );
+		// the stack is newest first
+		Node *oldest = nullptr;
+		while ( node ) {
+			auto next = node->next;
+			node->next = oldest;
+			oldest = node;
+			node = next;
+		}
+		size_t count = 0;
+		while ( oldest ) {
+			auto next = oldest->next;
+			oldest->destroy();
+			delete oldest;
+			oldest = next;
+			++count;
+		}
+		return count;
+	}
+
+private:
+	struct Node
+	{
+		std::function<void()> destroy;
+		Node *next;
+	};
+
+	std::atomic<Node *> head{ nullptr };
+};
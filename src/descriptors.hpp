@@ -0,0 +1,152 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "memory.hpp"
+
+/* hands out descriptor sets from a growing list of pools. Sets are never
+   freed one by one: reset() recycles every pool at once, so an allocator
+   per frame slot, reset when the slot's frame completes, makes transient sets
+   cost one pointer bump in the common case */
+struct DescriptorAllocator
+{
+	static constexpr uint32_t SETS_PER_POOL = 64;
+
+	void init( vk::Device device )
+	{
+		this->device = device;
+	}
+
+	vk::DescriptorSet allocate( vk::DescriptorSetLayout layout )
+	{
+		if ( current == pools.size() ) {
+			pools.emplace_back( createPool() );
+		}
+		auto alloc_info =
+		  vk::DescriptorSetAllocateInfo()
+			.setDescriptorPool( pools[ current ] )
+			.setDescriptorSetCount( 1 )
+			.setPSetLayouts( &layout );
+
+		vk::DescriptorSet set;
+		auto result = device.allocateDescriptorSets( &alloc_info, &set );
+		if ( result == vk::Result::eErrorOutOfPoolMemory || result == vk::Result::eErrorFragmentedPool ) {
+			// this pool is full, move on to the next one and try once more
+			if ( ++current == pools.size() ) {
+				pools.emplace_back( createPool() );
+			}
+			alloc_info.setDescriptorPool( pools[ current ] );
+			result = device.allocateDescriptorSets( &alloc_info, &set );
+		}
+		if ( result != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to allocate descriptor set" );
+		}
+		return set;
+	}
+
+	// every set allocated since the last reset becomes invalid
+	void reset()
+	{
+		for ( size_t i = 0; i <= current && i < pools.size(); ++i ) {
+			device.resetDescriptorPool( pools[ i ], vk::DescriptorPoolResetFlags{} );
+		}
+		current = 0;
+	}
+
+	size_t poolCount() const { return pools.size(); }
+
+	void destroy()
+	{
+		for ( auto &pool : pools ) {
+			device.destroy( pool );
+		}
+		pools.clear();
+		current = 0;
+	}
+
+private:
+	vk::DescriptorPool createPool()
+	{
+		// room for every kind of descriptor the app uses, a few per set
+		vk::DescriptorPoolSize pool_sizes[] = {
+			vk::DescriptorPoolSize( vk::DescriptorType::eUniformBuffer, SETS_PER_POOL ),
+			vk::DescriptorPoolSize( vk::DescriptorType::eUniformBufferDynamic, SETS_PER_POOL ),
+			vk::DescriptorPoolSize( vk::DescriptorType::eStorageBuffer, 4 * SETS_PER_POOL ),
+			vk::DescriptorPoolSize( vk::DescriptorType::eStorageImage, SETS_PER_POOL ),
+			vk::DescriptorPoolSize( vk::DescriptorType::eCombinedImageSampler, SETS_PER_POOL )
+		};
+		auto pool_info =
+		  vk::DescriptorPoolCreateInfo()
+			.setMaxSets( SETS_PER_POOL )
+			.setPoolSizeCount( sizeof( pool_sizes ) / sizeof( pool_sizes[ 0 ] ) )
+			.setPPoolSizes( pool_sizes );
+
+		vk::DescriptorPool pool;
+		if ( device.createDescriptorPool( &pool_info, nullptr, &pool ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to create descriptor pool" );
+		}
+		return pool;
+	}
+
+private:
+	vk::Device device;
+	std::vector<vk::DescriptorPool> pools;
+	// pools before this one are full
+	size_t current = 0;
+};
+
+/* uniform blocks pushed into the per-frame linear pool, whose buffer is
+   persistently mapped with one region per frame slot. Shaders see it through
+   a single dynamic uniform descriptor written once at startup, so per frame
+   data costs a memcpy into the slot's region and a dynamic offset at bind
+   time: no allocation, no descriptor update */
+struct UniformRing
+{
+	// block_range is the largest block push() takes and the range of the descriptor
+	void init( const vk::PhysicalDeviceLimits &limits, vk::DeviceSize block_range, LinearPool &pool )
+	{
+		this->block_range = block_range;
+		this->pool = &pool;
+		alignment = std::max<vk::DeviceSize>( limits.minUniformBufferOffsetAlignment, 16 );
+		if ( block_range > limits.maxUniformBufferRange || block_range > pool.capacity() ) {
+			throw std::runtime_error( "uniform ring block range too large" );
+		}
+	}
+
+	// copies one block into the pool's current region and returns its dynamic offset
+	uint32_t push( const void *data, vk::DeviceSize size )
+	{
+		if ( size > block_range ) {
+			throw std::runtime_error( "uniform block larger than the ring's range" );
+		}
+		auto slice = pool->allocate( size, alignment );
+		// a descriptor range past the end of the region would read the next slot's data
+		if ( slice.offset + block_range > pool->regionEnd() ) {
+			throw std::runtime_error( "uniform ring region exhausted" );
+		}
+		memcpy( slice.mapped, data, size );
+		return static_cast<uint32_t>( slice.offset );
+	}
+
+	template <typename T>
+	uint32_t push( const T &block )
+	{
+		return push( &block, sizeof( T ) );
+	}
+
+	// for the dynamic uniform descriptor, at offset 0
+	vk::DescriptorBufferInfo descriptorInfo() const
+	{
+		return vk::DescriptorBufferInfo( pool->buffer(), 0, block_range );
+	}
+
+private:
+	LinearPool *pool = nullptr;
+	vk::DeviceSize block_range = 0;
+	vk::DeviceSize alignment = 1;
+};
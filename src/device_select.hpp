@@ -0,0 +1,446 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "memory.hpp"
+
+// what a device must have for the application to run on it at all
+struct DeviceRequirements
+{
+	uint32_t api_version = VK_API_VERSION_1_0;
+	std::vector<const char *> extensions;
+	bool timeline_semaphore = false;
+	// views a multiview render pass must draw at once, 0 when multiview is not needed at all
+	uint32_t multiview_views = 0;
+	// a queue family must present to it, if set
+	vk::SurfaceKHR surface;
+	// formats that must support the features with optimal tiling
+	std::vector<std::pair<vk::Format, vk::FormatFeatureFlags>> formats;
+};
+
+struct DeviceCandidate
+{
+	vk::PhysicalDevice device;
+	std::string name;
+	std::string uuid;
+	// why the device cannot be used, empty if it can
+	std::string rejection;
+	// what the score is made of, one entry per criterion
+	std::vector<std::string> reasons;
+	int64_t score = 0;
+	// copy throughput of the microbenchmark, 0 if it did not run
+	double bench_gbps = 0;
+};
+
+/* ranks the instance's devices. Devices missing a requirement are rejected;
+   the others are scored by type, device local memory, limits and the queue
+   families the app makes use of. The microbenchmark, when run, ranks by
+   measured copy throughput instead and leaves the score as the tie break.
+   A preferred name or UUID overrides the ranking, and every decision is
+   logged */
+struct DeviceSelector
+{
+	static constexpr vk::DeviceSize BENCH_BYTES = 64ull << 20;
+	static constexpr uint32_t BENCH_COPIES = 8;
+
+	void init( vk::Instance instance, const DeviceRequirements &requirements )
+	{
+		candidates.clear();
+		for ( auto device : instance.enumeratePhysicalDevices() ) {
+			candidates.emplace_back( evaluate( device, requirements ) );
+		}
+		if ( candidates.empty() ) {
+			throw std::runtime_error( "failed to find GPUs with Vulkan support" );
+		}
+	}
+
+	// times a device to device copy on every usable device
+	void benchmark()
+	{
+		for ( auto &candidate : candidates ) {
+			if ( !candidate.rejection.empty() ) {
+				continue;
+			}
+			try {
+				candidate.bench_gbps = measureCopy( candidate.device );
+			} catch ( const std::exception &e ) {
+				std::cout << "benchmark on " << candidate.name << " failed: " << e.what() << std::endl;
+			}
+		}
+	}
+
+	/* the best usable device, or the best one matching preferred: a UUID,
+	   with or without dashes, or part of the device name */
+	const DeviceCandidate &select( const std::string &preferred, std::ostream &os )
+	{
+		std::vector<size_t> order;
+		for ( size_t i = 0; i < candidates.size(); ++i ) {
+			order.emplace_back( i );
+		}
+		std::stable_sort( order.begin(), order.end(), [this]( size_t a, size_t b ) {
+			auto &x = candidates[ a ];
+			auto &y = candidates[ b ];
+			if ( x.rejection.empty() != y.rejection.empty() ) {
+				return x.rejection.empty();
+			}
+			if ( x.bench_gbps != y.bench_gbps ) {
+				return x.bench_gbps > y.bench_gbps;
+			}
+			return x.score > y.score;
+		} );
+
+		for ( size_t i = 0; i < candidates.size(); ++i ) {
+			auto &candidate = candidates[ i ];
+			os << "device " << i << ": " << candidate.name << " [" << candidate.uuid << "]";
+			if ( !candidate.rejection.empty() ) {
+				os << " rejected: " << candidate.rejection << std::endl;
+				continue;
+			}
+			os << " score " << candidate.score;
+			if ( candidate.bench_gbps > 0 ) {
+				os << ", copies at " << candidate.bench_gbps << " GB/s";
+			}
+			os << ":";
+			for ( auto &reason : candidate.reasons ) {
+				os << ( &reason == &candidate.reasons.front() ? " " : ", " ) << reason;
+			}
+			os << std::endl;
+		}
+
+		const DeviceCandidate *chosen = nullptr;
+		std::string why;
+		for ( auto i : order ) {
+			auto &candidate = candidates[ i ];
+			if ( !preferred.empty() && !matches( candidate, preferred ) ) {
+				continue;
+			}
+			if ( !candidate.rejection.empty() ) {
+				// the override names a device that cannot run the app, better to say so than to ignore it
+				if ( !preferred.empty() ) {
+					throw std::runtime_error( "requested device " + candidate.name + " is unusable: " +
+											  candidate.rejection );
+				}
+				break;
+			}
+			chosen = &candidate;
+			why = !preferred.empty() ? "requested by --device" :
+				  candidate.bench_gbps > 0 ? "fastest in the copy benchmark" : "highest score";
+			break;
+		}
+		if ( !chosen ) {
+			throw std::runtime_error( preferred.empty() ? "no device meets the requirements" :
+														  "no device matches " + preferred );
+		}
+		os << "using " << chosen->name << ", " << why << std::endl;
+		return *chosen;
+	}
+
+	const std::vector<DeviceCandidate> &getCandidates() const { return candidates; }
+
+private:
+	static DeviceCandidate evaluate( vk::PhysicalDevice device, const DeviceRequirements &requirements )
+	{
+		DeviceCandidate candidate;
+		candidate.device = device;
+		auto properties = device.getProperties();
+		candidate.name = &properties.deviceName[ 0 ];
+		// the device UUID identifies the device across instances and processes
+		auto id_properties = vk::PhysicalDeviceIDProperties();
+		auto properties2 =
+		  vk::PhysicalDeviceProperties2()
+			.setPNext( &id_properties );
+		device.getProperties2( &properties2 );
+		candidate.uuid = formatUuid( id_properties.deviceUUID.data() );
+
+		candidate.rejection = rejection( device, properties, requirements );
+		if ( !candidate.rejection.empty() ) {
+			return candidate;
+		}
+
+		auto add = [&]( int64_t points, const std::string &reason ) {
+			candidate.score += points;
+			candidate.reasons.emplace_back( reason + " +" + std::to_string( points ) );
+		};
+
+		switch ( properties.deviceType ) {
+		case vk::PhysicalDeviceType::eDiscreteGpu: add( 10000, "discrete gpu" ); break;
+		case vk::PhysicalDeviceType::eIntegratedGpu: add( 5000, "integrated gpu" ); break;
+		case vk::PhysicalDeviceType::eVirtualGpu: add( 2000, "virtual gpu" ); break;
+		case vk::PhysicalDeviceType::eCpu: add( 100, "cpu" ); break;
+		default: add( 0, "other device type" ); break;
+		}
+
+		// integrated and cpu devices report host memory here, which the type already discounts
+		vk::DeviceSize local_bytes = 0;
+		auto memory = device.getMemoryProperties();
+		for ( uint32_t i = 0; i < memory.memoryHeapCount; ++i ) {
+			if ( memory.memoryHeaps[ i ].flags & vk::MemoryHeapFlagBits::eDeviceLocal ) {
+				local_bytes = std::max( local_bytes, memory.memoryHeaps[ i ].size );
+			}
+		}
+		auto local_mib = local_bytes >> 20;
+		add( std::min<int64_t>( local_mib / 16, 1024 ), std::to_string( local_mib ) + " MiB device local" );
+
+		auto &limits = properties.limits;
+		add( limits.maxImageDimension2D / 1024, "max image " + std::to_string( limits.maxImageDimension2D ) );
+		add( limits.maxComputeWorkGroupInvocations / 64,
+			 std::to_string( limits.maxComputeWorkGroupInvocations ) + " invocations per workgroup" );
+
+		// the app moves uploads and post processing off the graphics queue when it can
+		auto families = device.getQueueFamilyProperties();
+		bool transfer_only = false, async_compute = false;
+		for ( auto &family : families ) {
+			auto flags = family.queueFlags;
+			if ( !family.queueCount || flags & vk::QueueFlagBits::eGraphics ) {
+				continue;
+			}
+			transfer_only |= bool( flags & vk::QueueFlagBits::eTransfer ) && !( flags & vk::QueueFlagBits::eCompute );
+			async_compute |= bool( flags & vk::QueueFlagBits::eCompute );
+		}
+		if ( transfer_only ) {
+			add( 100, "transfer queue" );
+		}
+		if ( async_compute ) {
+			add( 200, "async compute queue" );
+		}
+		return candidate;
+	}
+
+	// empty when the device meets every requirement
+	static std::string rejection( vk::PhysicalDevice device, const vk::PhysicalDeviceProperties &properties,
+								  const DeviceRequirements &requirements )
+	{
+		if ( properties.apiVersion < requirements.api_version ) {
+			return "Vulkan " + std::to_string( VK_VERSION_MAJOR( properties.apiVersion ) ) + "." +
+				   std::to_string( VK_VERSION_MINOR( properties.apiVersion ) ) + " is too old";
+		}
+
+		auto available = device.enumerateDeviceExtensionProperties();
+		for ( auto extension : requirements.extensions ) {
+			auto found = std::find_if( available.begin(), available.end(), [&]( const vk::ExtensionProperties &p ) {
+				return strcmp( &p.extensionName[ 0 ], extension ) == 0;
+			} );
+			if ( found == available.end() ) {
+				return std::string( "missing " ) + extension;
+			}
+		}
+
+		auto multiview_features = vk::PhysicalDeviceMultiviewFeatures();
+		auto timeline_features =
+		  vk::PhysicalDeviceTimelineSemaphoreFeatures()
+			.setPNext( &multiview_features );
+		auto features =
+		  vk::PhysicalDeviceFeatures2()
+			.setPNext( &timeline_features );
+		device.getFeatures2( &features );
+		if ( requirements.timeline_semaphore && !timeline_features.timelineSemaphore ) {
+			return "no timeline semaphores";
+		}
+		if ( requirements.multiview_views ) {
+			auto multiview_properties = vk::PhysicalDeviceMultiviewProperties();
+			auto properties2 =
+			  vk::PhysicalDeviceProperties2()
+				.setPNext( &multiview_properties );
+			device.getProperties2( &properties2 );
+			if ( !multiview_features.multiview ) {
+				return "no multiview";
+			}
+			if ( multiview_properties.maxMultiviewViewCount < requirements.multiview_views ) {
+				return "multiview limited to " + std::to_string( multiview_properties.maxMultiviewViewCount ) + " views";
+			}
+		}
+
+		auto families = device.getQueueFamilyProperties();
+		bool graphics = false, present = !requirements.surface;
+		for ( uint32_t i = 0; i < families.size(); ++i ) {
+			if ( !families[ i ].queueCount ) {
+				continue;
+			}
+			graphics |= bool( families[ i ].queueFlags & vk::QueueFlagBits::eGraphics );
+			if ( requirements.surface && device.getSurfaceSupportKHR( i, requirements.surface ) ) {
+				present = true;
+			}
+		}
+		if ( !graphics ) {
+			return "no graphics queue";
+		}
+		if ( !present ) {
+			return "cannot present to the window";
+		}
+		if ( requirements.surface &&
+			 ( device.getSurfaceFormatsKHR( requirements.surface ).empty() ||
+			   device.getSurfacePresentModesKHR( requirements.surface ).empty() ) ) {
+			return "no surface formats or present modes";
+		}
+
+		for ( auto &format : requirements.formats ) {
+			auto features = device.getFormatProperties( format.first ).optimalTilingFeatures;
+			if ( ( features & format.second ) != format.second ) {
+				return vk::to_string( format.first ) + " lacks " + vk::to_string( format.second );
+			}
+		}
+		return "";
+	}
+
+	static std::string formatUuid( const uint8_t *uuid )
+	{
+		std::string text;
+		char hex[ 3 ];
+		for ( int i = 0; i < VK_UUID_SIZE; ++i ) {
+			if ( i == 4 || i == 6 || i == 8 || i == 10 ) {
+				text += '-';
+			}
+			snprintf( hex, sizeof( hex ), "%02x", uuid[ i ] );
+			text += hex;
+		}
+		return text;
+	}
+
+	static std::string normalize( const std::string &text, bool strip_dashes )
+	{
+		std::string out;
+		for ( auto c : text ) {
+			if ( !( strip_dashes && c == '-' ) ) {
+				out += static_cast<char>( std::tolower( static_cast<unsigned char>( c ) ) );
+			}
+		}
+		return out;
+	}
+
+	static bool matches( const DeviceCandidate &candidate, const std::string &preferred )
+	{
+		if ( normalize( candidate.uuid, true ) == normalize( preferred, true ) ) {
+			return true;
+		}
+		return normalize( candidate.name, false ).find( normalize( preferred, false ) ) != std::string::npos;
+	}
+
+	/* GB/s of BENCH_COPIES copies between two device local buffers, on a
+	   throwaway device with one graphics queue. The first submission warms
+	   up caches and clocks and is not counted */
+	static double measureCopy( vk::PhysicalDevice physical_device )
+	{
+		auto families = physical_device.getQueueFamilyProperties();
+		uint32_t family = 0;
+		while ( family < families.size() && !( families[ family ].queueFlags & vk::QueueFlagBits::eGraphics ) ) {
+			++family;
+		}
+
+		float priority = 1.f;
+		auto queue_info =
+		  vk::DeviceQueueCreateInfo()
+			.setQueueFamilyIndex( family )
+			.setQueueCount( 1 )
+			.setPQueuePriorities( &priority );
+		auto device_info =
+		  vk::DeviceCreateInfo()
+			.setQueueCreateInfoCount( 1 )
+			.setPQueueCreateInfos( &queue_info );
+
+		vk::Device device;
+		if ( physical_device.createDevice( &device_info, nullptr, &device ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to create benchmark device" );
+		}
+		MemoryAllocator allocator;
+		vk::Buffer buffers[ 2 ];
+		Allocation allocations[ 2 ];
+		vk::CommandPool pool;
+		auto cleanup = [&] {
+			device.waitIdle();
+			device.destroy( pool );
+			for ( int i = 0; i < 2; ++i ) {
+				device.destroy( buffers[ i ] );
+				allocator.free( allocations[ i ] );
+			}
+			allocator.destroy();
+			device.destroy();
+		};
+
+		double gbps = 0;
+		try {
+			allocator.init( physical_device, device );
+			auto buffer_info =
+			  vk::BufferCreateInfo()
+				.setSize( BENCH_BYTES )
+				.setUsage( vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst )
+				.setSharingMode( vk::SharingMode::eExclusive );
+			for ( int i = 0; i < 2; ++i ) {
+				if ( device.createBuffer( &buffer_info, nullptr, &buffers[ i ] ) != vk::Result::eSuccess ) {
+					throw std::runtime_error( "failed to create benchmark buffer" );
+				}
+				allocations[ i ] = allocator.allocateBuffer( buffers[ i ], vk::MemoryPropertyFlagBits::eDeviceLocal );
+			}
+
+			auto pool_info =
+			  vk::CommandPoolCreateInfo()
+				.setQueueFamilyIndex( family );
+			if ( device.createCommandPool( &pool_info, nullptr, &pool ) != vk::Result::eSuccess ) {
+				throw std::runtime_error( "failed to create benchmark command pool" );
+			}
+			auto alloc_info =
+			  vk::CommandBufferAllocateInfo()
+				.setCommandPool( pool )
+				.setLevel( vk::CommandBufferLevel::ePrimary )
+				.setCommandBufferCount( 1 );
+			vk::CommandBuffer command_buffer;
+			if ( device.allocateCommandBuffers( &alloc_info, &command_buffer ) != vk::Result::eSuccess ) {
+				throw std::runtime_error( "failed to allocate benchmark command buffer" );
+			}
+
+			auto begin_info = vk::CommandBufferBeginInfo();
+			if ( command_buffer.begin( &begin_info ) != vk::Result::eSuccess ) {
+				throw std::runtime_error( "failed to begin recording benchmark command buffer" );
+			}
+			command_buffer.fillBuffer( buffers[ 0 ], 0, VK_WHOLE_SIZE, 0x5a5a5a5a );
+			auto barrier =
+			  vk::MemoryBarrier()
+				.setSrcAccessMask( vk::AccessFlagBits::eTransferWrite )
+				.setDstAccessMask( vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite );
+			vk::BufferCopy region( 0, 0, BENCH_BYTES );
+			for ( uint32_t i = 0; i < BENCH_COPIES; ++i ) {
+				command_buffer.pipelineBarrier( vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer,
+												vk::DependencyFlags{}, 1, &barrier, 0, nullptr, 0, nullptr );
+				command_buffer.copyBuffer( buffers[ i % 2 ], buffers[ 1 - i % 2 ], 1, &region );
+			}
+			if ( vkEndCommandBuffer( command_buffer ) != VK_SUCCESS ) {
+				throw std::runtime_error( "failed to record benchmark command buffer" );
+			}
+
+			auto queue = device.getQueue( family, 0 );
+			auto submit_info =
+			  vk::SubmitInfo()
+				.setCommandBufferCount( 1 )
+				.setPCommandBuffers( &command_buffer );
+			double ms = 0;
+			for ( int run = 0; run < 2; ++run ) {
+				auto start = std::chrono::steady_clock::now();
+				if ( queue.submit( 1, &submit_info, vk::Fence{} ) != vk::Result::eSuccess ) {
+					throw std::runtime_error( "failed to submit benchmark command buffer" );
+				}
+				queue.waitIdle();
+				std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+				ms = elapsed.count();
+			}
+			gbps = double( BENCH_BYTES ) * BENCH_COPIES / ( ms * 1e6 );
+		} catch ( ... ) {
+			cleanup();
+			throw;
+		}
+		cleanup();
+		return gbps;
+	}
+
+private:
+	std::vector<DeviceCandidate> candidates;
+};
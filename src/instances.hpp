@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+// what the vertex shader reads per instance, at binding 1
+struct InstanceData
+{
+	// offset x, offset y, scale, rotation in radians
+	glm::vec4 transform;
+	glm::vec4 color;
+
+	static vk::VertexInputBindingDescription bindingDescription()
+	{
+		return vk::VertexInputBindingDescription()
+		  .setBinding( 1 )
+		  .setStride( sizeof( InstanceData ) )
+		  .setInputRate( vk::VertexInputRate::eInstance );
+	}
+
+	static std::vector<vk::VertexInputAttributeDescription> attributeDescriptions()
+	{
+		return {
+			vk::VertexInputAttributeDescription()
+			  .setBinding( 1 )
+			  .setLocation( 2 )
+			  .setFormat( vk::Format::eR32G32B32A32Sfloat )
+			  .setOffset( offsetof( InstanceData, transform ) ),
+			vk::VertexInputAttributeDescription()
+			  .setBinding( 1 )
+			  .setLocation( 3 )
+			  .setFormat( vk::Format::eR32G32B32A32Sfloat )
+			  .setOffset( offsetof( InstanceData, color ) )
+		};
+	}
+};
+
+/* the part of the world that is on screen; also the push constant block
+   of the culling shader, so the layout must match resources/cull.cs */
+struct CullView
+{
+	glm::vec2 center;
+	float half_extent;
+	uint32_t object_count;
+};
+
+/* instance state kept as structure of arrays, packed four instances to a
+   glm::vec4 so the per frame update is straight line packed float math with
+   no gathers; only write() transposes into the interleaved gpu layout.
+   A single instance sits still at the origin, which is the plain triangle */
+struct InstanceStore
+{
+	// instances are scattered over [ -extent, extent ] in both axes
+	void init( uint32_t count, float extent = 1.f, uint32_t seed = 1 )
+	{
+		this->count = count;
+		auto lanes = ( count + 3 ) / 4;
+		for ( auto array : { &pos_x, &pos_y, &vel_x, &vel_y, &angle, &spin, &scale, &red, &green, &blue } ) {
+			array->assign( lanes, glm::vec4( 0.f ) );
+		}
+		if ( count == 1 ) {
+			scale[ 0 ] = red[ 0 ] = green[ 0 ] = blue[ 0 ] = glm::vec4( 1.f );
+			return;
+		}
+
+		std::mt19937 rng( seed );
+		std::uniform_real_distribution<float> unit( -1.f, 1.f );
+		// sized so the instances roughly tile the area
+		auto size = 2.f * extent / std::sqrt( float( count ) );
+		for ( uint32_t i = 0; i < count; ++i ) {
+			auto lane = i / 4;
+			auto j = i % 4;
+			pos_x[ lane ][ j ] = extent * unit( rng );
+			pos_y[ lane ][ j ] = extent * unit( rng );
+			vel_x[ lane ][ j ] = .25f * unit( rng );
+			vel_y[ lane ][ j ] = .25f * unit( rng );
+			angle[ lane ][ j ] = 3.14159265f * unit( rng );
+			spin[ lane ][ j ] = 2.f * unit( rng );
+			scale[ lane ][ j ] = size * ( .75f + .25f * unit( rng ) );
+			red[ lane ][ j ] = .5f + .5f * unit( rng );
+			green[ lane ][ j ] = .5f + .5f * unit( rng );
+			blue[ lane ][ j ] = .5f + .5f * unit( rng );
+		}
+	}
+
+	// moves every instance by dt seconds, bouncing off the edges of clip space
+	void update( float dt )
+	{
+		const glm::vec4 delta( dt );
+		const glm::vec4 edge( 1.f );
+		const glm::vec4 turn( 6.28318531f );
+		for ( size_t i = 0; i < pos_x.size(); ++i ) {
+			auto x = pos_x[ i ] + vel_x[ i ] * delta;
+			auto y = pos_y[ i ] + vel_y[ i ] * delta;
+			vel_x[ i ] = glm::mix( vel_x[ i ], -vel_x[ i ], glm::greaterThan( glm::abs( x ), edge ) );
+			vel_y[ i ] = glm::mix( vel_y[ i ], -vel_y[ i ], glm::greaterThan( glm::abs( y ), edge ) );
+			pos_x[ i ] = glm::clamp( x, -edge, edge );
+			pos_y[ i ] = glm::clamp( y, -edge, edge );
+
+			auto a = angle[ i ] + spin[ i ] * delta;
+			angle[ i ] = a - turn * glm::floor( a / turn );
+		}
+	}
+
+	void write( InstanceData *out ) const
+	{
+		for ( uint32_t i = 0; i < count; ++i ) {
+			auto lane = i / 4;
+			auto j = i % 4;
+			out[ i ].transform = glm::vec4( pos_x[ lane ][ j ], pos_y[ lane ][ j ], scale[ lane ][ j ], angle[ lane ][ j ] );
+			out[ i ].color = glm::vec4( red[ lane ][ j ], green[ lane ][ j ], blue[ lane ][ j ], 1.f );
+		}
+	}
+
+	/* writes the instances overlapping the view and returns how many; they
+	   stay in world space, the view is applied by the vertex shader. Scale
+	   doubles as the bounding radius */
+	uint32_t cull( const CullView &view, InstanceData *out ) const
+	{
+		const glm::vec4 center_x( view.center.x );
+		const glm::vec4 center_y( view.center.y );
+		const glm::vec4 half_extent( view.half_extent );
+
+		uint32_t visible = 0;
+		for ( size_t i = 0; i < pos_x.size(); ++i ) {
+			auto reach = half_extent + scale[ i ];
+			auto inside = glm::lessThanEqual( glm::abs( pos_x[ i ] - center_x ), reach ) &&
+						  glm::lessThanEqual( glm::abs( pos_y[ i ] - center_y ), reach );
+			if ( !glm::any( inside ) ) {
+				continue;
+			}
+			for ( uint32_t j = 0; j < 4 && i * 4 + j < count; ++j ) {
+				if ( !inside[ j ] ) {
+					continue;
+				}
+				auto &instance = out[ visible++ ];
+				instance.transform = glm::vec4( pos_x[ i ][ j ], pos_y[ i ][ j ], scale[ i ][ j ], angle[ i ][ j ] );
+				instance.color = glm::vec4( red[ i ][ j ], green[ i ][ j ], blue[ i ][ j ], 1.f );
+			}
+		}
+		return visible;
+	}
+
+	uint32_t size() const { return count; }
+
+private:
+	uint32_t count = 0;
+	std::vector<glm::vec4> pos_x, pos_y;
+	std::vector<glm::vec4> vel_x, vel_y;
+	std::vector<glm::vec4> angle, spin;
+	std::vector<glm::vec4> scale;
+	std::vector<glm::vec4> red, green, blue;
+};
@@ -0,0 +1,268 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* read-only mapping of a whole file: data() points straight at the page
+   cache, so consumers read the file contents without any copy */
+struct MappedFile
+{
+	explicit MappedFile( const std::string &path )
+	{
+		auto fd = open( path.c_str(), O_RDONLY | O_CLOEXEC );
+		if ( fd < 0 ) {
+			throw std::runtime_error( "failed to open " + path + ": " + strerror( errno ) );
+		}
+		struct stat st;
+		if ( fstat( fd, &st ) != 0 ) {
+			auto err = errno;
+			close( fd );
+			throw std::runtime_error( "failed to stat " + path + ": " + strerror( err ) );
+		}
+		length = static_cast<size_t>( st.st_size );
+		// an empty file cannot be mapped, it is just empty
+		if ( length ) {
+			auto addr = mmap( nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0 );
+			if ( addr == MAP_FAILED ) {
+				auto err = errno;
+				close( fd );
+				throw std::runtime_error( "failed to map " + path + ": " + strerror( err ) );
+			}
+			address = static_cast<const char *>( addr );
+		}
+		close( fd );
+	}
+	~MappedFile()
+	{
+		if ( address ) {
+			munmap( const_cast<char *>( address ), length );
+		}
+	}
+
+	MappedFile( const MappedFile & ) = delete;
+	MappedFile &operator=( const MappedFile & ) = delete;
+
+	const char *data() const { return address; }
+	size_t size() const { return length; }
+
+	// pulls every page in, so the thread that consumes the data never blocks on disk
+	void prefault() const
+	{
+		if ( !address ) {
+			return;
+		}
+		madvise( const_cast<char *>( address ), length, MADV_WILLNEED );
+		auto page = static_cast<size_t>( sysconf( _SC_PAGESIZE ) );
+		volatile char sink = 0;
+		for ( size_t offset = 0; offset < length; offset += page ) {
+			sink = sink + address[ offset ];
+		}
+	}
+
+private:
+	const char *address = nullptr;
+	size_t length = 0;
+};
+
+enum class LoadPriority : int
+{
+	// prefetching that nothing is waiting on yet
+	Background,
+	// assets that show up on screen once they land
+	Streaming,
+	// startup blocks on these sooner or later
+	Startup
+};
+
+enum class LoadState : int
+{
+	Queued,
+	Loading,
+	Done,
+	Cancelled
+};
+
+// one requested file; file and error are only meaningful once the load is done
+struct AssetLoad
+{
+	std::string path;
+	LoadPriority priority;
+	std::shared_ptr<const MappedFile> file;
+	std::string error;
+
+	LoadState state() const { return current.load( std::memory_order_acquire ); }
+	bool cancelled() const { return cancel_requested.load( std::memory_order_acquire ); }
+
+	// a queued load is dropped, a finished one never runs its callback
+	void cancel() { cancel_requested.store( true, std::memory_order_release ); }
+
+private:
+	friend struct AssetLoader;
+
+	std::atomic<LoadState> current{ LoadState::Queued };
+	std::atomic<bool> cancel_requested{ false };
+	std::function<void( AssetLoad & )> callback;
+	uint64_t sequence = 0;
+};
+
+/* maps and pages in files on a small pool of i/o threads, highest priority
+   first and in request order within a priority. Completion callbacks do not
+   run on the i/o threads but in poll(), on the thread that owns the gpu
+   queues, so they can hand the mapped data straight to the uploader */
+struct AssetLoader
+{
+	explicit AssetLoader( uint32_t thread_count )
+	{
+		for ( uint32_t i = 0; i < thread_count; ++i ) {
+			threads.emplace_back( [this] { loop(); } );
+		}
+	}
+	~AssetLoader()
+	{
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			stopping = true;
+		}
+		work_cv.notify_all();
+		for ( auto &thread : threads ) {
+			thread.join();
+		}
+	}
+
+	AssetLoader( const AssetLoader & ) = delete;
+	AssetLoader &operator=( const AssetLoader & ) = delete;
+
+	std::shared_ptr<AssetLoad> load( const std::string &path, LoadPriority priority,
+									 std::function<void( AssetLoad & )> callback = {} )
+	{
+		auto job = std::make_shared<AssetLoad>();
+		job->path = path;
+		job->priority = priority;
+		job->callback = std::move( callback );
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			job->sequence = next_sequence++;
+			queue.push( job );
+		}
+		work_cv.notify_one();
+		return job;
+	}
+
+	/* blocks until the load is done; one still queued is loaded right here
+	   instead of waiting behind everything queued before it */
+	AssetLoad &wait( const std::shared_ptr<AssetLoad> &job )
+	{
+		auto expected = LoadState::Queued;
+		if ( job->current.compare_exchange_strong( expected, LoadState::Loading ) ) {
+			execute( job );
+			return *job;
+		}
+		std::unique_lock<std::mutex> lock( mutex );
+		done_cv.wait( lock, [&] {
+			auto state = job->state();
+			return state == LoadState::Done || state == LoadState::Cancelled;
+		} );
+		return *job;
+	}
+
+	// runs the callbacks of finished loads on the calling thread
+	size_t poll()
+	{
+		std::deque<std::shared_ptr<AssetLoad>> finished;
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			finished.swap( completed );
+		}
+		size_t delivered = 0;
+		for ( auto &job : finished ) {
+			if ( !job->cancelled() ) {
+				job->callback( *job );
+				++delivered;
+			}
+		}
+		return delivered;
+	}
+
+	uint32_t size() const { return static_cast<uint32_t>( threads.size() ); }
+
+private:
+	struct Later
+	{
+		bool operator()( const std::shared_ptr<AssetLoad> &a, const std::shared_ptr<AssetLoad> &b ) const
+		{
+			if ( a->priority != b->priority ) {
+				return a->priority < b->priority;
+			}
+			return a->sequence > b->sequence;
+		}
+	};
+
+	void loop()
+	{
+		while ( true ) {
+			std::shared_ptr<AssetLoad> job;
+			{
+				std::unique_lock<std::mutex> lock( mutex );
+				work_cv.wait( lock, [this] { return stopping || !queue.empty(); } );
+				if ( stopping ) {
+					return;
+				}
+				job = queue.top();
+				queue.pop();
+			}
+			// wait() may have taken it already
+			auto expected = LoadState::Queued;
+			if ( job->current.compare_exchange_strong( expected, LoadState::Loading ) ) {
+				execute( job );
+			}
+		}
+	}
+
+	void execute( const std::shared_ptr<AssetLoad> &job )
+	{
+		auto state = LoadState::Cancelled;
+		if ( !job->cancelled() ) {
+			try {
+				auto file = std::make_shared<MappedFile>( job->path );
+				file->prefault();
+				job->file = std::move( file );
+			} catch ( const std::exception &e ) {
+				job->error = e.what();
+			}
+			state = LoadState::Done;
+		}
+
+		std::lock_guard<std::mutex> lock( mutex );
+		job->current.store( state, std::memory_order_release );
+		if ( state == LoadState::Done && job->callback ) {
+			completed.emplace_back( job );
+		}
+		done_cv.notify_all();
+	}
+
+private:
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable work_cv;
+	std::condition_variable done_cv;
+	std::priority_queue<std::shared_ptr<AssetLoad>, std::vector<std::shared_ptr<AssetLoad>>, Later> queue;
+	std::deque<std::shared_ptr<AssetLoad>> completed;
+	uint64_t next_sequence = 0;
+	bool stopping = false;
+};
@@ -0,0 +1,453 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+/* power-of-two buddy allocator over [0, capacity); every range is naturally
+   aligned to its rounded-up size, so alignment comes for free */
+struct BuddyAllocator
+{
+	BuddyAllocator( uint64_t capacity, uint64_t min_block = 256 ) :
+	  min_order( log2( min_block ) ),
+	  max_order( log2( capacity ) )
+	{
+		if ( capacity != ( 1ull << max_order ) || min_block != ( 1ull << min_order ) || min_order > max_order ) {
+			throw std::runtime_error( "buddy allocator sizes must be powers of two" );
+		}
+		free_lists.resize( max_order - min_order + 1 );
+		free_lists.back().insert( 0 );
+	}
+
+	std::optional<uint64_t> allocate( uint64_t size, uint64_t alignment = 1 )
+	{
+		auto order = orderFor( std::max( size, alignment ) );
+		if ( order > max_order ) {
+			return std::nullopt;
+		}
+		auto k = order;
+		while ( k <= max_order && free_lists[ k - min_order ].empty() ) {
+			++k;
+		}
+		if ( k > max_order ) {
+			return std::nullopt;
+		}
+		auto &list = free_lists[ k - min_order ];
+		auto offset = *list.begin();
+		list.erase( list.begin() );
+		// split down, handing the upper halves back to the free lists
+		while ( k > order ) {
+			--k;
+			free_lists[ k - min_order ].insert( offset + ( 1ull << k ) );
+		}
+		allocated.emplace( offset, order );
+		used_bytes += 1ull << order;
+		return offset;
+	}
+
+	void free( uint64_t offset )
+	{
+		auto it = allocated.find( offset );
+		if ( it == allocated.end() ) {
+			throw std::runtime_error( "buddy allocator freed an unknown offset" );
+		}
+		auto order = it->second;
+		allocated.erase( it );
+		used_bytes -= 1ull << order;
+		// merge with the buddy for as long as it is free too
+		while ( order < max_order ) {
+			auto &list = free_lists[ order - min_order ];
+			auto buddy = list.find( offset ^ ( 1ull << order ) );
+			if ( buddy == list.end() ) {
+				break;
+			}
+			offset = std::min( offset, *buddy );
+			list.erase( buddy );
+			++order;
+		}
+		free_lists[ order - min_order ].insert( offset );
+	}
+
+	uint64_t capacity() const { return 1ull << max_order; }
+	uint64_t used() const { return used_bytes; }
+	size_t allocationCount() const { return allocated.size(); }
+
+	uint64_t largestFree() const
+	{
+		for ( auto k = max_order + 1; k-- > min_order; ) {
+			if ( !free_lists[ k - min_order ].empty() ) {
+				return 1ull << k;
+			}
+		}
+		return 0;
+	}
+
+private:
+	static uint32_t log2( uint64_t value )
+	{
+		uint32_t order = 0;
+		while ( ( 1ull << order ) < value ) {
+			++order;
+		}
+		return order;
+	}
+
+	uint32_t orderFor( uint64_t size ) const { return std::max( min_order, log2( size ) ); }
+
+private:
+	uint32_t min_order;
+	uint32_t max_order;
+	// free offsets per order, index 0 is min_order
+	std::vector<std::set<uint64_t>> free_lists;
+	std::unordered_map<uint64_t, uint32_t> allocated;
+	uint64_t used_bytes = 0;
+};
+
+// bump allocator, released wholesale by reset()
+struct LinearAllocator
+{
+	LinearAllocator( uint64_t capacity = 0 ) :
+	  capacity( capacity )
+	{
+	}
+
+	std::optional<uint64_t> allocate( uint64_t size, uint64_t alignment = 1 )
+	{
+		auto offset = ( head + alignment - 1 ) / alignment * alignment;
+		if ( offset + size > capacity ) {
+			return std::nullopt;
+		}
+		head = offset + size;
+		peak = std::max( peak, head );
+		return offset;
+	}
+
+	void reset() { head = 0; }
+
+	uint64_t used() const { return head; }
+
+	uint64_t capacity;
+	uint64_t peak = 0;
+
+private:
+	uint64_t head = 0;
+};
+
+struct Allocation
+{
+	vk::DeviceMemory memory;
+	vk::DeviceSize offset = 0;
+	vk::DeviceSize size = 0;
+	// host address of offset, null unless the memory is host visible
+	void *mapped = nullptr;
+	uint32_t block = ~0u;
+
+	explicit operator bool() const { return bool( memory ); }
+};
+
+struct MemoryStats
+{
+	// vkAllocateMemory calls currently alive and the bytes they reserve
+	uint64_t block_count = 0;
+	uint64_t reserved_bytes = 0;
+	// bytes handed out to resources, after rounding
+	uint64_t used_bytes = 0;
+	uint64_t allocation_count = 0;
+	// 1 - largest free range / total free, over all sub-allocated blocks
+	double fragmentation = 0;
+	// per-frame linear pool: one slot's region, and the most a frame has bumped through it
+	uint64_t linear_region_bytes = 0;
+	uint64_t linear_peak_bytes = 0;
+};
+
+/* long-lived resources are sub-allocated from large blocks per memory type
+   with a buddy allocator; requests larger than a block get one of their own */
+struct MemoryAllocator
+{
+	static constexpr vk::DeviceSize BLOCK_SIZE = 64ull << 20;
+
+	void init( vk::PhysicalDevice physical_device, vk::Device device )
+	{
+		this->device = device;
+		memory_properties = physical_device.getMemoryProperties();
+		auto limits = physical_device.getProperties().limits;
+		max_allocations = limits.maxMemoryAllocationCount;
+		// linear and optimal resources may share a block, keep them granularity apart
+		granularity = limits.bufferImageGranularity;
+	}
+
+	uint32_t findMemoryType( uint32_t type_filter, vk::MemoryPropertyFlags properties ) const
+	{
+		for ( uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i ) {
+			if ( ( type_filter & ( 1u << i ) ) &&
+				 ( memory_properties.memoryTypes[ i ].propertyFlags & properties ) == properties ) {
+				return i;
+			}
+		}
+		throw std::runtime_error( "failed to find suitable memory type" );
+	}
+
+	Allocation allocate( const vk::MemoryRequirements &requirements, vk::MemoryPropertyFlags properties )
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+
+		auto memory_type = findMemoryType( requirements.memoryTypeBits, properties );
+		auto alignment = std::max( requirements.alignment, granularity );
+
+		if ( requirements.size > BLOCK_SIZE / 2 ) {
+			return allocateDedicated( requirements.size, memory_type );
+		}
+
+		for ( uint32_t i = 0; i < blocks.size(); ++i ) {
+			auto &block = blocks[ i ];
+			if ( !block || block->dedicated || block->memory_type != memory_type ) {
+				continue;
+			}
+			if ( auto offset = block->buddy.allocate( requirements.size, alignment ) ) {
+				return suballocation( i, *offset, requirements.size );
+			}
+		}
+
+		auto index = createBlock( BLOCK_SIZE, memory_type, false );
+		auto offset = blocks[ index ]->buddy.allocate( requirements.size, alignment );
+		return suballocation( index, offset.value(), requirements.size );
+	}
+
+	void free( const Allocation &allocation )
+	{
+		if ( !allocation ) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock( mutex );
+		auto &block = blocks[ allocation.block ];
+		if ( block->dedicated ) {
+			destroyBlock( allocation.block );
+		} else {
+			block->buddy.free( allocation.offset );
+		}
+	}
+
+	Allocation allocateBuffer( vk::Buffer buffer, vk::MemoryPropertyFlags properties )
+	{
+		auto allocation = allocate( device.getBufferMemoryRequirements( buffer ), properties );
+		device.bindBufferMemory( buffer, allocation.memory, allocation.offset );
+		return allocation;
+	}
+
+	Allocation allocateImage( vk::Image image, vk::MemoryPropertyFlags properties )
+	{
+		auto allocation = allocate( device.getImageMemoryRequirements( image ), properties );
+		device.bindImageMemory( image, allocation.memory, allocation.offset );
+		return allocation;
+	}
+
+	MemoryStats stats() const
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		MemoryStats stats;
+		uint64_t free_bytes = 0;
+		uint64_t largest_free = 0;
+		for ( auto &block : blocks ) {
+			if ( !block ) {
+				continue;
+			}
+			++stats.block_count;
+			stats.reserved_bytes += block->size;
+			if ( block->dedicated ) {
+				stats.used_bytes += block->size;
+				++stats.allocation_count;
+			} else {
+				stats.used_bytes += block->buddy.used();
+				stats.allocation_count += block->buddy.allocationCount();
+				free_bytes += block->buddy.capacity() - block->buddy.used();
+				largest_free = std::max( largest_free, block->buddy.largestFree() );
+			}
+		}
+		stats.fragmentation = free_bytes ? 1. - double( largest_free ) / free_bytes : 0.;
+		return stats;
+	}
+
+	void destroy()
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		for ( uint32_t i = 0; i < blocks.size(); ++i ) {
+			if ( blocks[ i ] ) {
+				destroyBlock( i );
+			}
+		}
+		blocks.clear();
+	}
+
+private:
+	struct Block
+	{
+		vk::DeviceMemory memory;
+		vk::DeviceSize size;
+		uint32_t memory_type;
+		bool dedicated;
+		void *mapped;
+		BuddyAllocator buddy;
+	};
+
+	Allocation suballocation( uint32_t index, vk::DeviceSize offset, vk::DeviceSize size )
+	{
+		auto &block = blocks[ index ];
+		Allocation allocation;
+		allocation.memory = block->memory;
+		allocation.offset = offset;
+		allocation.size = size;
+		allocation.mapped = block->mapped ? static_cast<char *>( block->mapped ) + offset : nullptr;
+		allocation.block = index;
+		return allocation;
+	}
+
+	Allocation allocateDedicated( vk::DeviceSize size, uint32_t memory_type )
+	{
+		return suballocation( createBlock( size, memory_type, true ), 0, size );
+	}
+
+	uint32_t createBlock( vk::DeviceSize size, uint32_t memory_type, bool dedicated )
+	{
+		auto live = std::count_if( blocks.begin(), blocks.end(), []( auto &b ) { return bool( b ); } );
+		if ( static_cast<uint64_t>( live ) >= max_allocations ) {
+			throw std::runtime_error( "exceeded maxMemoryAllocationCount" );
+		}
+
+		auto alloc_info =
+		  vk::MemoryAllocateInfo()
+			.setAllocationSize( size )
+			.setMemoryTypeIndex( memory_type );
+
+		vk::DeviceMemory memory;
+		if ( device.allocateMemory( &alloc_info, nullptr, &memory ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to allocate device memory" );
+		}
+
+		// host visible blocks stay mapped for their whole lifetime
+		void *mapped = nullptr;
+		auto flags = memory_properties.memoryTypes[ memory_type ].propertyFlags;
+		if ( flags & vk::MemoryPropertyFlagBits::eHostVisible ) {
+			if ( device.mapMemory( memory, 0, VK_WHOLE_SIZE, vk::MemoryMapFlags{}, &mapped ) != vk::Result::eSuccess ) {
+				throw std::runtime_error( "failed to map device memory" );
+			}
+		}
+
+		auto block = std::unique_ptr<Block>( new Block{
+		  memory, size, memory_type, dedicated, mapped,
+		  BuddyAllocator( dedicated ? 256 : size ) } );
+
+		// reuse the slot of a released dedicated block so indices stay small
+		for ( uint32_t i = 0; i < blocks.size(); ++i ) {
+			if ( !blocks[ i ] ) {
+				blocks[ i ] = std::move( block );
+				return i;
+			}
+		}
+		blocks.emplace_back( std::move( block ) );
+		return blocks.size() - 1;
+	}
+
+	void destroyBlock( uint32_t index )
+	{
+		// freeing mapped memory implicitly unmaps it
+		device.freeMemory( blocks[ index ]->memory );
+		blocks[ index ].reset();
+	}
+
+private:
+	vk::Device device;
+	vk::PhysicalDeviceMemoryProperties memory_properties;
+	vk::DeviceSize granularity = 1;
+	uint32_t max_allocations = 4096;
+	std::vector<std::unique_ptr<Block>> blocks;
+	mutable std::mutex mutex;
+};
+
+/* per-frame data: one buffer carved out of the allocator with a region per
+   frame slot. A frame bumps through its slot's region, which is reset in one
+   go once the slot's previous frame has retired */
+struct LinearPool
+{
+	// regions start aligned to this, so offsets within them keep their alignment
+	static constexpr vk::DeviceSize REGION_ALIGNMENT = 256;
+
+	struct Slice
+	{
+		// into buffer(), which every region shares
+		vk::DeviceSize offset = 0;
+		void *mapped = nullptr;
+	};
+
+	void init( vk::Device device, MemoryAllocator &allocator, vk::DeviceSize region_size, uint32_t region_count,
+			   vk::BufferUsageFlags usage, vk::MemoryPropertyFlags properties )
+	{
+		this->device = device;
+		this->region_size = ( region_size + REGION_ALIGNMENT - 1 ) / REGION_ALIGNMENT * REGION_ALIGNMENT;
+		auto buffer_info =
+		  vk::BufferCreateInfo()
+			.setSize( this->region_size * region_count )
+			.setUsage( usage )
+			.setSharingMode( vk::SharingMode::eExclusive );
+
+		if ( device.createBuffer( &buffer_info, nullptr, &pool_buffer ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to create linear pool buffer" );
+		}
+		allocation = allocator.allocateBuffer( pool_buffer, properties );
+		if ( !allocation.mapped ) {
+			throw std::runtime_error( "linear pool memory must be host visible" );
+		}
+		linear = LinearAllocator( this->region_size );
+	}
+
+	// starts over in the slot's region, whose previous frame the gpu is done with
+	void begin( size_t slot )
+	{
+		region = slot * region_size;
+		linear.reset();
+	}
+
+	Slice allocate( vk::DeviceSize size, vk::DeviceSize alignment = 1 )
+	{
+		if ( alignment > REGION_ALIGNMENT ) {
+			throw std::runtime_error( "linear pool alignment too large" );
+		}
+		auto offset = linear.allocate( size, alignment );
+		if ( !offset ) {
+			throw std::runtime_error( "linear pool exhausted" );
+		}
+		return Slice{ region + *offset, static_cast<char *>( allocation.mapped ) + region + *offset };
+	}
+
+	// where the current region ends, in buffer()
+	vk::DeviceSize regionEnd() const { return region + region_size; }
+
+	vk::Buffer buffer() const { return pool_buffer; }
+
+	void destroy( MemoryAllocator &allocator )
+	{
+		device.destroy( pool_buffer );
+		allocator.free( allocation );
+		pool_buffer = nullptr;
+		allocation = Allocation();
+	}
+
+	vk::DeviceSize used() const { return linear.used(); }
+	vk::DeviceSize peak() const { return linear.peak; }
+	vk::DeviceSize capacity() const { return linear.capacity; }
+
+private:
+	vk::Device device;
+	vk::Buffer pool_buffer;
+	Allocation allocation;
+	LinearAllocator linear;
+	vk::DeviceSize region_size = 0;
+	vk::DeviceSize region = 0;
+};
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include "memory.hpp"
+
+struct Vertex
+{
+	glm::vec2 position;
+	glm::vec3 color;
+
+	static vk::VertexInputBindingDescription bindingDescription()
+	{
+		return vk::VertexInputBindingDescription()
+		  .setBinding( 0 )
+		  .setStride( sizeof( Vertex ) )
+		  .setInputRate( vk::VertexInputRate::eVertex );
+	}
+
+	static std::vector<vk::VertexInputAttributeDescription> attributeDescriptions()
+	{
+		return {
+			vk::VertexInputAttributeDescription()
+			  .setBinding( 0 )
+			  .setLocation( 0 )
+			  .setFormat( vk::Format::eR32G32Sfloat )
+			  .setOffset( offsetof( Vertex, position ) ),
+			vk::VertexInputAttributeDescription()
+			  .setBinding( 0 )
+			  .setLocation( 1 )
+			  .setFormat( vk::Format::eR32G32B32Sfloat )
+			  .setOffset( offsetof( Vertex, color ) )
+		};
+	}
+};
+
+struct MeshData
+{
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+};
+
+/* on disk a mesh is this header followed by the vertices and then the
+   indices, exactly as they are laid out in the gpu buffers, so a mapped file
+   can be handed to the uploader as is */
+struct MeshFileHeader
+{
+	char magic[ 4 ];
+	uint32_t vertex_count;
+	uint32_t index_count;
+	uint32_t version;
+};
+
+constexpr char MESH_FILE_MAGIC[ 4 ] = { 'M', 'E', 'S', 'H' };
+// bumped whenever the layout behind the header changes
+constexpr uint32_t MESH_FILE_VERSION = 1;
+
+// validates a mapped mesh file and returns its header, throws if it is malformed
+inline MeshFileHeader parseMeshFile( const char *data, size_t size )
+{
+	MeshFileHeader header;
+	if ( size < sizeof( header ) ) {
+		throw std::runtime_error( "mesh file is truncated" );
+	}
+	memcpy( &header, data, sizeof( header ) );
+	if ( memcmp( header.magic, MESH_FILE_MAGIC, sizeof( header.magic ) ) != 0 ) {
+		throw std::runtime_error( "not a mesh file" );
+	}
+	if ( header.version != MESH_FILE_VERSION ) {
+		throw std::runtime_error( "unknown mesh file version " + std::to_string( header.version ) );
+	}
+	auto expected = sizeof( header ) +
+					uint64_t( header.vertex_count ) * sizeof( Vertex ) +
+					uint64_t( header.index_count ) * sizeof( uint32_t );
+	if ( size != expected || !header.index_count ) {
+		throw std::runtime_error( "mesh file is truncated" );
+	}
+	// the gpu fetches vertices unchecked, one index out of range reads past the vertex buffer
+	auto indices = reinterpret_cast<const uint32_t *>( data + expected - header.index_count * sizeof( uint32_t ) );
+	if ( *std::max_element( indices, indices + header.index_count ) >= header.vertex_count ) {
+		throw std::runtime_error( "mesh file index out of range" );
+	}
+	return header;
+}
+
+inline void writeMeshFile( const std::string &path, const MeshData &mesh )
+{
+	MeshFileHeader header;
+	memcpy( header.magic, MESH_FILE_MAGIC, sizeof( header.magic ) );
+	header.vertex_count = static_cast<uint32_t>( mesh.vertices.size() );
+	header.index_count = static_cast<uint32_t>( mesh.indices.size() );
+	header.version = MESH_FILE_VERSION;
+
+	std::ofstream os( path, std::ios::binary | std::ios::trunc );
+	os.write( reinterpret_cast<const char *>( &header ), sizeof( header ) );
+	os.write( reinterpret_cast<const char *>( mesh.vertices.data() ), mesh.vertices.size() * sizeof( Vertex ) );
+	os.write( reinterpret_cast<const char *>( mesh.indices.data() ), mesh.indices.size() * sizeof( uint32_t ) );
+	if ( !os.good() ) {
+		throw std::runtime_error( "failed to write mesh file" );
+	}
+}
+
+/* the classic triangle for a count of 1, otherwise that many smaller copies
+   laid out on a grid so vertex and index traffic scales with the count */
+inline MeshData buildTriangleMesh( uint32_t triangle_count )
+{
+	static const glm::vec2 corners[] = { { 0.f, -.5f }, { .5f, .5f }, { -.5f, .5f } };
+	static const glm::vec3 colors[] = { { 1.f, 0.f, 0.f }, { 0.f, 1.f, 0.f }, { 0.f, 0.f, 1.f } };
+
+	uint32_t side = 1;
+	while ( side * side < triangle_count ) {
+		++side;
+	}
+	auto cell = 2.f / side;
+
+	MeshData mesh;
+	mesh.vertices.reserve( 3 * triangle_count );
+	mesh.indices.reserve( 3 * triangle_count );
+	for ( uint32_t i = 0; i < triangle_count; ++i ) {
+		glm::vec2 center( -1.f + cell * ( i % side + .5f ), -1.f + cell * ( i / side + .5f ) );
+		for ( uint32_t j = 0; j < 3; ++j ) {
+			mesh.indices.emplace_back( static_cast<uint32_t>( mesh.vertices.size() ) );
+			mesh.vertices.emplace_back( Vertex{ center + corners[ j ] * ( cell / 2 ), colors[ j ] } );
+		}
+	}
+	return mesh;
+}
+
+// device local vertex and index buffers, drawable once both uploads have been flushed
+struct Mesh
+{
+	vk::Buffer vertex_buffer;
+	vk::Buffer index_buffer;
+	Allocation vertex_allocation;
+	Allocation index_allocation;
+	uint32_t index_count = 0;
+	uint32_t pending_uploads = 0;
+
+	bool ready() const { return index_count && !pending_uploads; }
+};
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "profiler.hpp"
+
+/* one timeline semaphore counting finished frames: frame n signals n + 1
+   when its commands complete. Whether a frame is done and waiting for it
+   are a counter read and a wait on a value, and there is nothing to reset */
+struct FrameTimeline
+{
+	void init( vk::Device device )
+	{
+		this->device = device;
+		auto type_info =
+		  vk::SemaphoreTypeCreateInfo()
+			.setSemaphoreType( vk::SemaphoreType::eTimeline )
+			.setInitialValue( 0 );
+		auto semaphore_info =
+		  vk::SemaphoreCreateInfo()
+			.setPNext( &type_info );
+
+		if ( device.createSemaphore( &semaphore_info, nullptr, &semaphore ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to create frame timeline semaphore" );
+		}
+	}
+
+	vk::Semaphore handle() const { return semaphore; }
+
+	// what frame signals once it is complete
+	static uint64_t value( uint64_t frame ) { return frame + 1; }
+
+	// the number of frames complete so far
+	uint64_t completed() const
+	{
+		uint64_t value = 0;
+		if ( device.getSemaphoreCounterValue( semaphore, &value ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to read frame timeline" );
+		}
+		return value;
+	}
+
+	// blocks until the counter reaches value, at once for 0
+	void wait( uint64_t value ) const
+	{
+		auto wait_info =
+		  vk::SemaphoreWaitInfo()
+			.setSemaphoreCount( 1 )
+			.setPSemaphores( &semaphore )
+			.setPValues( &value );
+
+		if ( device.waitSemaphores( &wait_info, std::numeric_limits<uint64_t>::max() ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to wait for frame timeline" );
+		}
+	}
+
+	void destroy()
+	{
+		device.destroy( semaphore );
+	}
+
+private:
+	vk::Device device;
+	vk::Semaphore semaphore;
+};
+
+struct PacingStats
+{
+	// frames held back by the cap, the latency target or just in time sampling
+	uint64_t paced = 0;
+	double wait_ms = 0;
+	// from sampling input until the frame was seen complete on the host, an upper bound
+	Percentiles latency_ms;
+	// running estimates the pacing decisions are based on
+	double cpu_ms = 0;
+	double gpu_ms = 0;
+};
+
+/* decides when the next frame may start, which is when it samples input.
+   The frame rate cap spaces frame starts; the latency target bounds how
+   many frames may be queued ahead of the gpu; just in time sampling keeps
+   one frame queued and delays the next until the gpu is about to need it,
+   so its input is as fresh as the gpu time allows */
+struct FramePacer
+{
+	// keeps a little slack so a slow frame does not leave the gpu idle
+	static constexpr double JIT_MARGIN_MS = 1.;
+	static constexpr size_t LATENCY_WINDOW = 4096;
+
+	void init( const FrameTimeline &timeline, uint32_t frames_in_flight,
+			   double max_fps, double target_latency_ms, bool just_in_time )
+	{
+		this->timeline = &timeline;
+		this->frames_in_flight = frames_in_flight;
+		this->target_latency_ms = target_latency_ms;
+		this->just_in_time = just_in_time;
+		period = max_fps > 0 ? std::chrono::duration<double>( 1. / max_fps ) : std::chrono::duration<double>( 0 );
+		deadline = Clock::now();
+	}
+
+	// blocks until frame may start
+	void pace( uint64_t frame )
+	{
+		auto start = Clock::now();
+		// a frame that was never submitted, say after a failed acquire, never completes
+		if ( !sampled.empty() && sampled.back().first > last_submitted ) {
+			sampled.pop_back();
+		}
+		observe( timeline->completed(), start );
+
+		if ( period.count() > 0 ) {
+			std::this_thread::sleep_until( deadline );
+			// a late frame moves the cadence instead of letting the next ones catch up in a burst
+			deadline = std::max( deadline + std::chrono::duration_cast<Clock::duration>( period ), Clock::now() );
+		}
+
+		auto depth = queueDepth();
+		auto blocked = false;
+		if ( frame >= depth ) {
+			// the frame depth frames back must be done before this one starts, or the last one signaling
+			auto value = std::min( FrameTimeline::value( frame - depth ), last_signaling );
+			if ( timeline->completed() < value ) {
+				timeline->wait( value );
+				blocked = true;
+			}
+			observe( value, Clock::now() );
+		}
+		/* having just waited for it, the frame before the previous one has
+		   finished and the previous one starts on the gpu now; start this
+		   one so that it is submitted just as that one completes */
+		if ( just_in_time && blocked && depth > 1 && gpu_ms > 0 ) {
+			auto lead = gpu_ms - cpu_ms - JIT_MARGIN_MS;
+			if ( lead > 0 ) {
+				std::this_thread::sleep_for( std::chrono::duration<double, std::milli>( lead ) );
+			}
+		}
+
+		sample_time = Clock::now();
+		std::chrono::duration<double, std::milli> waited = sample_time - start;
+		if ( waited.count() > 0.01 ) {
+			++stats.paced;
+			stats.wait_ms += waited.count();
+		}
+		sampled.emplace_back( FrameTimeline::value( frame ), sample_time );
+	}
+
+	/* the frame started by the last pace() has been submitted, to signal
+	   value; unless signaling, the submission that signals it is held back
+	   and reported through signaling() once it goes out */
+	void submitted( uint64_t value, bool signaling = true )
+	{
+		last_submitted = value;
+		if ( signaling ) {
+			last_signaling = value;
+		}
+		std::chrono::duration<double, std::milli> elapsed = Clock::now() - sample_time;
+		cpu_ms = smooth( cpu_ms, elapsed.count() );
+	}
+
+	// the held back submission signaling value went out, waits may reach it now
+	void signaling( uint64_t value ) { last_signaling = value; }
+
+	// a gpu time measured for some completed frame
+	void gpuTime( double ms )
+	{
+		if ( ms >= 0 ) {
+			gpu_ms = smooth( gpu_ms, ms );
+		}
+	}
+
+	PacingStats getStats() const
+	{
+		auto result = stats;
+		result.latency_ms = computePercentiles( std::vector<double>( latencies.begin(), latencies.end() ) );
+		result.cpu_ms = cpu_ms;
+		result.gpu_ms = gpu_ms;
+		return result;
+	}
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	// frames allowed in flight, the one about to start included
+	uint64_t queueDepth() const
+	{
+		uint64_t depth = frames_in_flight;
+		if ( target_latency_ms > 0 ) {
+			// until there are estimates, one frame at a time is what meets any target
+			auto frame_ms = std::max( cpu_ms, gpu_ms );
+			depth = frame_ms > 0 ? static_cast<uint64_t>( target_latency_ms / frame_ms ) : 1;
+		}
+		if ( just_in_time ) {
+			depth = std::min<uint64_t>( depth, 2 );
+		}
+		return std::clamp<uint64_t>( depth, 1, frames_in_flight );
+	}
+
+	// every sampled frame up to completed is done by now
+	void observe( uint64_t completed, Clock::time_point now )
+	{
+		while ( !sampled.empty() && sampled.front().first <= completed ) {
+			std::chrono::duration<double, std::milli> latency = now - sampled.front().second;
+			latencies.emplace_back( latency.count() );
+			if ( latencies.size() > LATENCY_WINDOW ) {
+				latencies.pop_front();
+			}
+			sampled.pop_front();
+		}
+	}
+
+	static double smooth( double average, double sample )
+	{
+		return average > 0 ? average + .1 * ( sample - average ) : sample;
+	}
+
+private:
+	const FrameTimeline *timeline = nullptr;
+	uint32_t frames_in_flight = 1;
+	double target_latency_ms = 0;
+	bool just_in_time = false;
+	std::chrono::duration<double> period{ 0 };
+	Clock::time_point deadline;
+	Clock::time_point sample_time;
+	uint64_t last_submitted = 0;
+	uint64_t last_signaling = 0;
+	// timeline value and sampling time of frames not seen complete yet
+	std::deque<std::pair<uint64_t, Clock::time_point>> sampled;
+	std::deque<double> latencies;
+	double cpu_ms = 0;
+	double gpu_ms = 0;
+	PacingStats stats;
+};
@@ -0,0 +1,278 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+enum class ProfileStage : uint32_t
+{
+	Pace,
+	FrameWait,
+	Update,
+	Acquire,
+	ImageWait,
+	Record,
+	Submit,
+	Present,
+	Count
+};
+
+inline const char *profileStageName( ProfileStage stage )
+{
+	static const char *names[] = {
+		"pace",
+		"frame_wait",
+		"update",
+		"acquire",
+		"image_wait",
+		"record",
+		"submit",
+		"present"
+	};
+	return names[ static_cast<uint32_t>( stage ) ];
+}
+
+constexpr auto PROFILE_STAGE_COUNT = static_cast<size_t>( ProfileStage::Count );
+
+struct FrameRecord
+{
+	uint64_t frame = 0;
+	// cpu time between the start of this frame and the start of the previous one
+	double frame_ms = 0;
+	// render pass time from gpu timestamps, negative when unavailable
+	double gpu_ms = -1;
+	std::array<double, PROFILE_STAGE_COUNT> stage_ms{};
+
+	double &stage( ProfileStage stage ) { return stage_ms[ static_cast<size_t>( stage ) ]; }
+};
+
+struct ScopedTimer
+{
+	ScopedTimer( double &out_ms ) :
+	  out_ms( out_ms ),
+	  start( std::chrono::steady_clock::now() )
+	{
+	}
+	~ScopedTimer()
+	{
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		out_ms = elapsed.count();
+	}
+
+private:
+	double &out_ms;
+	std::chrono::steady_clock::time_point start;
+};
+
+/* single producer ring of frame records: the render thread pushes without
+   locking, readers copy slots out and drop any slot torn by a concurrent push */
+template <size_t N>
+struct FrameRing
+{
+	static_assert( N && !( N & ( N - 1 ) ), "ring capacity must be a power of two" );
+
+	void push( const FrameRecord &record )
+	{
+		auto idx = head.load( std::memory_order_relaxed );
+		auto &slot = slots[ idx & ( N - 1 ) ];
+		// odd sequence marks the slot as being written
+		slot.seq.store( 2 * idx + 1, std::memory_order_relaxed );
+		std::atomic_thread_fence( std::memory_order_release );
+		slot.record = record;
+		slot.seq.store( 2 * idx + 2, std::memory_order_release );
+		head.store( idx + 1, std::memory_order_release );
+	}
+
+	// copies up to `count` most recent records, oldest first
+	std::vector<FrameRecord> snapshot( size_t count = N ) const
+	{
+		auto end = head.load( std::memory_order_acquire );
+		auto begin = end - std::min<uint64_t>( std::min( count, N ), end );
+
+		std::vector<FrameRecord> records;
+		records.reserve( end - begin );
+		for ( auto idx = begin; idx < end; ++idx ) {
+			auto &slot = slots[ idx & ( N - 1 ) ];
+			auto seq = slot.seq.load( std::memory_order_acquire );
+			if ( seq != 2 * idx + 2 ) {
+				continue;
+			}
+			auto record = slot.record;
+			std::atomic_thread_fence( std::memory_order_acquire );
+			if ( slot.seq.load( std::memory_order_relaxed ) == seq ) {
+				records.emplace_back( record );
+			}
+		}
+		return records;
+	}
+
+	uint64_t size() const { return head.load( std::memory_order_acquire ); }
+
+private:
+	struct Slot
+	{
+		std::atomic<uint64_t> seq{ 0 };
+		FrameRecord record;
+	};
+
+	std::unique_ptr<Slot[]> slots{ new Slot[ N ] };
+	std::atomic<uint64_t> head{ 0 };
+};
+
+struct Percentiles
+{
+	double p50 = 0;
+	double p95 = 0;
+	double p99 = 0;
+};
+
+inline Percentiles computePercentiles( std::vector<double> values )
+{
+	Percentiles result;
+	if ( values.empty() ) {
+		return result;
+	}
+	std::sort( values.begin(), values.end() );
+	auto at = [&]( double p ) {
+		auto idx = static_cast<size_t>( std::ceil( p * values.size() ) );
+		return values[ std::min( values.size(), std::max<size_t>( idx, 1 ) ) - 1 ];
+	};
+	result.p50 = at( .50 );
+	result.p95 = at( .95 );
+	result.p99 = at( .99 );
+	return result;
+}
+
+struct Profiler
+{
+	static constexpr size_t RING_SIZE = 1 << 14;
+
+	Profiler( uint32_t report_interval = 240 ) :
+	  report_interval( report_interval )
+	{
+	}
+
+	// stamps the frame interval; stage timings are filled in by the caller
+	FrameRecord beginFrame( uint64_t frame )
+	{
+		auto now = std::chrono::steady_clock::now();
+		FrameRecord record;
+		record.frame = frame;
+		if ( frame_started ) {
+			std::chrono::duration<double, std::milli> elapsed = now - last_frame_start;
+			record.frame_ms = elapsed.count();
+		}
+		last_frame_start = now;
+		frame_started = true;
+		return record;
+	}
+
+	void push( const FrameRecord &record )
+	{
+		ring.push( record );
+		if ( report_interval && ring.size() % report_interval == 0 ) {
+			report();
+		}
+	}
+
+	Percentiles frameTimes( size_t window ) const
+	{
+		return computePercentiles( collect( window, []( const FrameRecord &r ) { return r.frame_ms; } ) );
+	}
+
+	Percentiles gpuTimes( size_t window ) const
+	{
+		return computePercentiles( collect( window, []( const FrameRecord &r ) { return r.gpu_ms; } ) );
+	}
+
+	Percentiles stageTimes( ProfileStage stage, size_t window ) const
+	{
+		auto idx = static_cast<size_t>( stage );
+		return computePercentiles( collect( window, [=]( const FrameRecord &r ) { return r.stage_ms[ idx ]; } ) );
+	}
+
+	void report() const
+	{
+		auto cpu = frameTimes( report_interval );
+		auto gpu = gpuTimes( report_interval );
+		std::cout << "frame ms p50/p95/p99: "
+				  << cpu.p50 << " / " << cpu.p95 << " / " << cpu.p99;
+		if ( gpu.p50 > 0 ) {
+			std::cout << ", gpu ms p50/p95/p99: "
+					  << gpu.p50 << " / " << gpu.p95 << " / " << gpu.p99;
+		}
+		std::cout << std::endl;
+	}
+
+	// writes every retained record, as json if the path ends with .json and csv otherwise
+	void dump( const std::string &path ) const
+	{
+		std::ofstream os( path, std::ios::trunc );
+		if ( !os.is_open() ) {
+			throw std::runtime_error( "failed to open profile dump file" );
+		}
+		auto records = ring.snapshot();
+		auto json = path.size() >= 5 && path.compare( path.size() - 5, 5, ".json" ) == 0;
+
+		if ( json ) {
+			os << "[\n";
+		} else {
+			os << "frame,frame_ms,gpu_ms";
+			for ( size_t i = 0; i < PROFILE_STAGE_COUNT; ++i ) {
+				os << "," << profileStageName( static_cast<ProfileStage>( i ) ) << "_ms";
+			}
+			os << "\n";
+		}
+
+		for ( size_t i = 0; i < records.size(); ++i ) {
+			auto &r = records[ i ];
+			if ( json ) {
+				os << "  { \"frame\": " << r.frame
+				   << ", \"frame_ms\": " << r.frame_ms
+				   << ", \"gpu_ms\": " << r.gpu_ms;
+				for ( size_t j = 0; j < PROFILE_STAGE_COUNT; ++j ) {
+					os << ", \"" << profileStageName( static_cast<ProfileStage>( j ) ) << "_ms\": " << r.stage_ms[ j ];
+				}
+				os << " }" << ( i + 1 < records.size() ? "," : "" ) << "\n";
+			} else {
+				os << r.frame << "," << r.frame_ms << "," << r.gpu_ms;
+				for ( size_t j = 0; j < PROFILE_STAGE_COUNT; ++j ) {
+					os << "," << r.stage_ms[ j ];
+				}
+				os << "\n";
+			}
+		}
+
+		if ( json ) {
+			os << "]\n";
+		}
+	}
+
+private:
+	template <typename F>
+	std::vector<double> collect( size_t window, F &&field ) const
+	{
+		std::vector<double> values;
+		for ( auto &record : ring.snapshot( window ) ) {
+			// the first frame has no interval and gpu time may be missing
+			if ( field( record ) > 0 ) {
+				values.emplace_back( field( record ) );
+			}
+		}
+		return values;
+	}
+
+private:
+	uint32_t report_interval;
+	FrameRing<RING_SIZE> ring;
+	std::chrono::steady_clock::time_point last_frame_start;
+	bool frame_started = false;
+};
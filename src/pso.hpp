@@ -0,0 +1,494 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "loader.hpp"
+
+// 64 bit fnv-1a, fed field by field so padding never reaches the hash
+struct StateHasher
+{
+	uint64_t value = 14695981039346656037ull;
+
+	void add( const void *data, size_t size )
+	{
+		auto bytes = static_cast<const unsigned char *>( data );
+		for ( size_t i = 0; i < size; ++i ) {
+			value = ( value ^ bytes[ i ] ) * 1099511628211ull;
+		}
+	}
+
+	template <typename T>
+	void add( const T &field )
+	{
+		add( &field, sizeof( field ) );
+	}
+};
+
+/* everything that goes into a graphics pipeline; two descriptions that
+   hash the same build the same pipeline */
+struct GraphicsPipelineDesc
+{
+	std::shared_ptr<const MappedFile> vertex_shader;
+	std::shared_ptr<const MappedFile> fragment_shader;
+	// fragment shader specialization constants, constant_id i takes element i
+	std::vector<float> fragment_constants;
+	std::vector<vk::VertexInputBindingDescription> bindings;
+	std::vector<vk::VertexInputAttributeDescription> attributes;
+	vk::PrimitiveTopology topology = vk::PrimitiveTopology::eTriangleList;
+	vk::PolygonMode polygon_mode = vk::PolygonMode::eFill;
+	vk::CullModeFlags cull_mode = vk::CullModeFlagBits::eBack;
+	vk::FrontFace front_face = vk::FrontFace::eClockwise;
+	bool blend = false;
+	vk::PipelineLayout layout;
+	vk::RenderPass render_pass;
+	uint32_t subpass = 0;
+
+	uint64_t hash() const
+	{
+		StateHasher hasher;
+		for ( auto &shader : { vertex_shader, fragment_shader } ) {
+			hasher.add( shader->size() );
+			hasher.add( shader->data(), shader->size() );
+		}
+		hasher.add( fragment_constants.size() );
+		hasher.add( fragment_constants.data(), fragment_constants.size() * sizeof( float ) );
+		hasher.add( bindings.size() );
+		for ( auto &binding : bindings ) {
+			hasher.add( binding.binding );
+			hasher.add( binding.stride );
+			hasher.add( binding.inputRate );
+		}
+		hasher.add( attributes.size() );
+		for ( auto &attribute : attributes ) {
+			hasher.add( attribute.location );
+			hasher.add( attribute.binding );
+			hasher.add( attribute.format );
+			hasher.add( attribute.offset );
+		}
+		hasher.add( topology );
+		hasher.add( polygon_mode );
+		hasher.add( static_cast<VkCullModeFlags>( cull_mode ) );
+		hasher.add( front_face );
+		hasher.add( blend );
+		hasher.add( static_cast<VkPipelineLayout>( layout ) );
+		hasher.add( static_cast<VkRenderPass>( render_pass ) );
+		hasher.add( subpass );
+		return hasher.value;
+	}
+};
+
+struct PipelineStats
+{
+	uint64_t requests = 0;
+	// requests answered by a pipeline that was already built or queued
+	uint64_t deduplicated = 0;
+	uint64_t compiled = 0;
+	uint64_t batches = 0;
+	// pipelines in batches that failed to build, each forgotten so a later request retries it
+	uint64_t failed = 0;
+	// times a caller got the fallback because its variant was still compiling
+	uint64_t fallbacks = 0;
+};
+
+// where a key stands: queued or compiling, built, or unknown, which a failed build leaves behind
+enum class PipelineState
+{
+	Pending,
+	Ready,
+	Failed
+};
+
+/* owns every graphics pipeline, keyed by the hash of its full state.
+   submit() queues a description and returns at once; compile threads take
+   whatever is queued, up to BATCH_SIZE at a time, and build it with one
+   createGraphicsPipelines call. get() hands out the pipeline when it is
+   ready and the caller's fallback until then, so a new variant never
+   stalls a frame */
+struct PipelineManager
+{
+	static constexpr size_t BATCH_SIZE = 16;
+
+	void init( vk::Device device, vk::PipelineCache cache, uint32_t thread_count )
+	{
+		this->device = device;
+		this->cache = cache;
+		for ( uint32_t i = 0; i < thread_count; ++i ) {
+			threads.emplace_back( [this] { loop(); } );
+		}
+	}
+
+	uint64_t submit( const GraphicsPipelineDesc &desc )
+	{
+		auto key = desc.hash();
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			++stats.requests;
+			if ( entries.count( key ) ) {
+				++stats.deduplicated;
+				return key;
+			}
+			entries[ key ] = vk::Pipeline{};
+			queue.emplace_back( key, desc );
+		}
+		work_cv.notify_one();
+		return key;
+	}
+
+	vk::Pipeline get( uint64_t key, vk::Pipeline fallback )
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		auto it = entries.find( key );
+		if ( it != entries.end() && it->second ) {
+			return it->second;
+		}
+		++stats.fallbacks;
+		return fallback;
+	}
+
+	PipelineState state( uint64_t key ) const
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		auto it = entries.find( key );
+		if ( it == entries.end() ) {
+			return PipelineState::Failed;
+		}
+		return it->second ? PipelineState::Ready : PipelineState::Pending;
+	}
+
+	/* forgets key and hands its pipeline to the caller, who may still have
+	   frames drawing with it; null while it is not built. A queued compile
+	   is dropped, one already running destroys what it builds */
+	vk::Pipeline remove( uint64_t key )
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		auto it = entries.find( key );
+		if ( it == entries.end() ) {
+			return vk::Pipeline{};
+		}
+		auto pipeline = it->second;
+		entries.erase( it );
+		queue.erase( std::remove_if( queue.begin(), queue.end(),
+									 [key]( const auto &entry ) { return entry.first == key; } ),
+					 queue.end() );
+		return pipeline;
+	}
+
+	// builds on the calling thread, for pipelines there is no fallback for
+	vk::Pipeline compile( const GraphicsPipelineDesc &desc )
+	{
+		auto key = desc.hash();
+		{
+			std::unique_lock<std::mutex> lock( mutex );
+			++stats.requests;
+			auto it = entries.find( key );
+			if ( it != entries.end() ) {
+				++stats.deduplicated;
+				// queued or compiling elsewhere, wait for it rather than building it twice
+				done_cv.wait( lock, [&] {
+					auto found = entries.find( key );
+					return found == entries.end() || found->second;
+				} );
+				// a failed build forgets its keys
+				it = entries.find( key );
+				if ( it == entries.end() ) {
+					throw std::runtime_error( "failed to create graphics pipeline" );
+				}
+				return it->second;
+			}
+			entries[ key ] = vk::Pipeline{};
+		}
+		std::vector<std::pair<uint64_t, GraphicsPipelineDesc>> batch = { { key, desc } };
+		build( batch );
+		std::lock_guard<std::mutex> lock( mutex );
+		return entries[ key ];
+	}
+
+	/* waits for every queued and running compile, then forgets all pipelines
+	   and hands them to the caller, who may still have frames drawing with them */
+	std::vector<vk::Pipeline> release()
+	{
+		std::unique_lock<std::mutex> lock( mutex );
+		done_cv.wait( lock, [this] { return queue.empty() && !building; } );
+		std::vector<vk::Pipeline> released;
+		for ( auto &entry : entries ) {
+			released.emplace_back( entry.second );
+		}
+		entries.clear();
+		return released;
+	}
+
+	// release(), destroying them right away
+	void clear()
+	{
+		for ( auto &pipeline : release() ) {
+			device.destroy( pipeline );
+		}
+	}
+
+	void destroy()
+	{
+		clear();
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			stopping = true;
+		}
+		work_cv.notify_all();
+		for ( auto &thread : threads ) {
+			thread.join();
+		}
+		threads.clear();
+	}
+
+	PipelineStats getStats() const
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		return stats;
+	}
+
+private:
+	// create infos point into each other, so every build keeps them in one place
+	struct Build
+	{
+		vk::ShaderModule modules[ 2 ];
+		vk::PipelineShaderStageCreateInfo stages[ 2 ];
+		std::vector<vk::SpecializationMapEntry> constant_entries;
+		vk::SpecializationInfo specialization;
+		vk::PipelineVertexInputStateCreateInfo vertex_input;
+		vk::PipelineInputAssemblyStateCreateInfo input_assembly;
+		vk::PipelineViewportStateCreateInfo viewport;
+		vk::DynamicState dynamic_states[ 2 ];
+		vk::PipelineDynamicStateCreateInfo dynamic;
+		vk::PipelineRasterizationStateCreateInfo rasterizer;
+		vk::PipelineMultisampleStateCreateInfo multisampling;
+		vk::PipelineColorBlendAttachmentState blend_attachment;
+		vk::PipelineColorBlendStateCreateInfo blending;
+	};
+
+	void loop()
+	{
+		while ( true ) {
+			std::vector<std::pair<uint64_t, GraphicsPipelineDesc>> batch;
+			{
+				std::unique_lock<std::mutex> lock( mutex );
+				work_cv.wait( lock, [this] { return stopping || !queue.empty(); } );
+				if ( stopping ) {
+					return;
+				}
+				while ( !queue.empty() && batch.size() < BATCH_SIZE ) {
+					batch.emplace_back( std::move( queue.front() ) );
+					queue.pop_front();
+				}
+				++building;
+			}
+			try {
+				build( batch );
+			} catch ( const std::exception &e ) {
+				// the variants keep drawing with the fallback until they are submitted again
+				std::cerr << "pipeline batch failed: " << e.what() << std::endl;
+			}
+			{
+				std::lock_guard<std::mutex> lock( mutex );
+				--building;
+			}
+			done_cv.notify_all();
+		}
+	}
+
+	vk::ShaderModule createModule( const MappedFile &code )
+	{
+		auto create_info =
+		  vk::ShaderModuleCreateInfo()
+			.setCodeSize( code.size() )
+			.setPCode( reinterpret_cast<const uint32_t *>( code.data() ) );
+
+		vk::ShaderModule module;
+		if ( device.createShaderModule( &create_info, nullptr, &module ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to create shader module" );
+		}
+		return module;
+	}
+
+	void fill( Build &build, const GraphicsPipelineDesc &desc, vk::GraphicsPipelineCreateInfo &info )
+	{
+		build.modules[ 0 ] = createModule( *desc.vertex_shader );
+		build.modules[ 1 ] = createModule( *desc.fragment_shader );
+
+		for ( uint32_t i = 0; i < desc.fragment_constants.size(); ++i ) {
+			build.constant_entries.emplace_back( i, i * sizeof( float ), sizeof( float ) );
+		}
+		build.specialization
+		  .setMapEntryCount( build.constant_entries.size() )
+		  .setPMapEntries( build.constant_entries.data() )
+		  .setDataSize( desc.fragment_constants.size() * sizeof( float ) )
+		  .setPData( desc.fragment_constants.data() );
+
+		build.stages[ 0 ]
+		  .setStage( vk::ShaderStageFlagBits::eVertex )
+		  .setModule( build.modules[ 0 ] )
+		  .setPName( "main" );
+		build.stages[ 1 ]
+		  .setStage( vk::ShaderStageFlagBits::eFragment )
+		  .setModule( build.modules[ 1 ] )
+		  .setPName( "main" )
+		  .setPSpecializationInfo( desc.fragment_constants.empty() ? nullptr : &build.specialization );
+
+		build.vertex_input
+		  .setVertexBindingDescriptionCount( desc.bindings.size() )
+		  .setPVertexBindingDescriptions( desc.bindings.data() )
+		  .setVertexAttributeDescriptionCount( desc.attributes.size() )
+		  .setPVertexAttributeDescriptions( desc.attributes.data() );
+
+		build.input_assembly
+		  .setTopology( desc.topology )
+		  .setPrimitiveRestartEnable( false );
+
+		// viewport and scissor are set at record time, so pipelines outlive extent changes
+		build.viewport
+		  .setViewportCount( 1 )
+		  .setScissorCount( 1 );
+		build.dynamic_states[ 0 ] = vk::DynamicState::eViewport;
+		build.dynamic_states[ 1 ] = vk::DynamicState::eScissor;
+		build.dynamic
+		  .setDynamicStateCount( 2 )
+		  .setPDynamicStates( build.dynamic_states );
+
+		build.rasterizer
+		  .setDepthClampEnable( false )
+		  .setRasterizerDiscardEnable( false )
+		  .setPolygonMode( desc.polygon_mode )
+		  .setLineWidth( 1.f )
+		  .setCullMode( desc.cull_mode )
+		  .setFrontFace( desc.front_face );
+
+		build.multisampling
+		  .setSampleShadingEnable( false )
+		  .setRasterizationSamples( vk::SampleCountFlagBits::e1 );
+
+		build.blend_attachment
+		  .setColorWriteMask( vk::ColorComponentFlagBits::eR |
+							  vk::ColorComponentFlagBits::eG |
+							  vk::ColorComponentFlagBits::eB |
+							  vk::ColorComponentFlagBits::eA )
+		  .setBlendEnable( desc.blend )
+		  .setSrcColorBlendFactor( vk::BlendFactor::eSrcAlpha )
+		  .setDstColorBlendFactor( vk::BlendFactor::eOneMinusSrcAlpha )
+		  .setColorBlendOp( vk::BlendOp::eAdd )
+		  .setSrcAlphaBlendFactor( vk::BlendFactor::eOne )
+		  .setDstAlphaBlendFactor( vk::BlendFactor::eZero )
+		  .setAlphaBlendOp( vk::BlendOp::eAdd );
+
+		build.blending
+		  .setLogicOpEnable( false )
+		  .setLogicOp( vk::LogicOp::eCopy )
+		  .setAttachmentCount( 1 )
+		  .setPAttachments( &build.blend_attachment )
+		  .setBlendConstants( { 0.f, 0.f, 0.f, 0.f } );
+
+		info
+		  .setStageCount( 2 )
+		  .setPStages( build.stages )
+		  .setPVertexInputState( &build.vertex_input )
+		  .setPInputAssemblyState( &build.input_assembly )
+		  .setPViewportState( &build.viewport )
+		  .setPRasterizationState( &build.rasterizer )
+		  .setPMultisampleState( &build.multisampling )
+		  .setPColorBlendState( &build.blending )
+		  .setPDynamicState( &build.dynamic )
+		  .setLayout( desc.layout )
+		  .setRenderPass( desc.render_pass )
+		  .setSubpass( desc.subpass );
+	}
+
+	void build( const std::vector<std::pair<uint64_t, GraphicsPipelineDesc>> &batch )
+	{
+		std::vector<std::unique_ptr<Build>> builds;
+		std::vector<vk::Pipeline> pipelines( batch.size() );
+		vk::Result result;
+		try {
+			std::vector<vk::GraphicsPipelineCreateInfo> infos( batch.size() );
+			for ( size_t i = 0; i < batch.size(); ++i ) {
+				builds.emplace_back( std::make_unique<Build>() );
+				fill( *builds.back(), batch[ i ].second, infos[ i ] );
+			}
+			result = device.createGraphicsPipelines( cache, infos.size(), infos.data(), nullptr, pipelines.data() );
+		} catch ( ... ) {
+			// the modules made before the throw, which may be half of a pair
+			destroyModules( builds );
+			fail( batch );
+			throw;
+		}
+		destroyModules( builds );
+		if ( result != vk::Result::eSuccess ) {
+			// the pipelines that did build come back alongside the error
+			for ( auto &pipeline : pipelines ) {
+				device.destroy( pipeline );
+			}
+			fail( batch );
+			throw std::runtime_error( "failed to create graphics pipeline" );
+		}
+
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			for ( size_t i = 0; i < batch.size(); ++i ) {
+				auto it = entries.find( batch[ i ].first );
+				// removed while compiling, or submitted again meanwhile and built by that request first
+				if ( it == entries.end() || it->second ) {
+					device.destroy( pipelines[ i ] );
+				} else {
+					it->second = pipelines[ i ];
+				}
+			}
+			stats.compiled += batch.size();
+			++stats.batches;
+		}
+		done_cv.notify_all();
+	}
+
+	void destroyModules( const std::vector<std::unique_ptr<Build>> &builds )
+	{
+		for ( auto &build : builds ) {
+			device.destroy( build->modules[ 0 ] );
+			device.destroy( build->modules[ 1 ] );
+		}
+	}
+
+	/* forgets the batch's keys: a later submit() queues them again, and
+	   compile() calls waiting on them throw instead of waiting forever */
+	void fail( const std::vector<std::pair<uint64_t, GraphicsPipelineDesc>> &batch )
+	{
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			for ( auto &entry : batch ) {
+				entries.erase( entry.first );
+			}
+			stats.failed += batch.size();
+		}
+		done_cv.notify_all();
+	}
+
+private:
+	vk::Device device;
+	vk::PipelineCache cache;
+	std::vector<std::thread> threads;
+	mutable std::mutex mutex;
+	std::condition_variable work_cv;
+	std::condition_variable done_cv;
+	// null while queued or compiling, absent once a build failed
+	std::unordered_map<uint64_t, vk::Pipeline> entries;
+	std::deque<std::pair<uint64_t, GraphicsPipelineDesc>> queue;
+	uint32_t building = 0;
+	bool stopping = false;
+	PipelineStats stats;
+};
@@ -0,0 +1,675 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "memory.hpp"
+
+// how a pass touches a resource; layout only matters for images
+struct ResourceUse
+{
+	vk::PipelineStageFlags stages;
+	vk::AccessFlags access;
+	vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+};
+
+inline vk::AccessFlags writeAccess( vk::AccessFlags access )
+{
+	return access & ( vk::AccessFlagBits::eShaderWrite |
+					  vk::AccessFlagBits::eColorAttachmentWrite |
+					  vk::AccessFlagBits::eDepthStencilAttachmentWrite |
+					  vk::AccessFlagBits::eTransferWrite |
+					  vk::AccessFlagBits::eHostWrite |
+					  vk::AccessFlagBits::eMemoryWrite );
+}
+
+struct AliasRequest
+{
+	vk::DeviceSize size;
+	vk::DeviceSize alignment;
+	// first and last position in pass order that touch the resource
+	uint32_t first;
+	uint32_t last;
+};
+
+/* places each request at the lowest offset that does not overlap any
+   request alive at the same time, biggest first; returns the heap size */
+inline vk::DeviceSize assignAliasOffsets( const std::vector<AliasRequest> &requests, std::vector<vk::DeviceSize> &offsets )
+{
+	std::vector<size_t> order( requests.size() );
+	for ( size_t i = 0; i < order.size(); ++i ) {
+		order[ i ] = i;
+	}
+	std::stable_sort( order.begin(), order.end(), [&]( size_t a, size_t b ) {
+		return requests[ a ].size > requests[ b ].size;
+	} );
+
+	offsets.assign( requests.size(), 0 );
+	std::vector<size_t> placed;
+	vk::DeviceSize heap_size = 0;
+	for ( auto i : order ) {
+		auto &request = requests[ i ];
+		auto alive = [&]( size_t j ) {
+			return requests[ j ].first <= request.last && request.first <= requests[ j ].last;
+		};
+		// every candidate is either the start of the heap or the end of a live neighbour
+		std::vector<vk::DeviceSize> candidates = { 0 };
+		for ( auto j : placed ) {
+			if ( alive( j ) ) {
+				candidates.emplace_back( offsets[ j ] + requests[ j ].size );
+			}
+		}
+		std::sort( candidates.begin(), candidates.end() );
+		for ( auto candidate : candidates ) {
+			auto offset = ( candidate + request.alignment - 1 ) / request.alignment * request.alignment;
+			auto fits = std::none_of( placed.begin(), placed.end(), [&]( size_t j ) {
+				return alive( j ) && offset < offsets[ j ] + requests[ j ].size && offsets[ j ] < offset + request.size;
+			} );
+			if ( fits ) {
+				offsets[ i ] = offset;
+				break;
+			}
+		}
+		placed.emplace_back( i );
+		heap_size = std::max( heap_size, offsets[ i ] + request.size );
+	}
+	return heap_size;
+}
+
+// what a pass gets to record with
+struct FrameContext
+{
+	vk::CommandBuffer command_buffer;
+	size_t slot;
+	uint32_t image_index;
+};
+
+/* declarative frame graph. Passes declare what they read and write, in the
+   order they are added; compile() drops passes nothing observable depends
+   on, orders the rest, works out the barriers and layout transitions between
+   them and aliases the memory of transient images whose lifetimes do not
+   overlap. Imported resources are bound to this frame's handles before
+   execute(), so one compiled graph serves every frame slot */
+struct RenderGraph
+{
+	using ResourceId = uint32_t;
+	using PassId = uint32_t;
+
+	struct Stats
+	{
+		uint32_t passes = 0;
+		uint32_t culled_passes = 0;
+		// barrier structs recorded per frame, and pipelineBarrier calls they are batched into
+		uint32_t barriers = 0;
+		uint32_t barrier_batches = 0;
+		uint32_t transient_images = 0;
+		// what the transients would take on their own, and with aliasing
+		vk::DeviceSize transient_bytes = 0;
+		vk::DeviceSize aliased_bytes = 0;
+	};
+
+	// state the image is in when the frame starts, e.g. undefined for a freshly acquired image
+	ResourceId importImage( const std::string &name, ResourceUse initial,
+							vk::ImageAspectFlags aspect = vk::ImageAspectFlagBits::eColor )
+	{
+		auto id = addResource( name, true, false );
+		resources[ id ].initial = initial;
+		resources[ id ].aspect = aspect;
+		return id;
+	}
+
+	// memory dependencies on earlier frames are assumed to be covered by the frame waits
+	ResourceId importBuffer( const std::string &name )
+	{
+		return addResource( name, false, false );
+	}
+
+	/* owned by the graph, sized to the extent given to compile() divided by
+	   divisor; view() covers every layer, as an array view if there are several */
+	ResourceId createImage( const std::string &name, vk::Format format, vk::ImageUsageFlags usage,
+							uint32_t layers = 1, vk::Extent2D divisor = { 1, 1 },
+							vk::ImageAspectFlags aspect = vk::ImageAspectFlagBits::eColor )
+	{
+		auto id = addResource( name, true, true );
+		resources[ id ].format = format;
+		resources[ id ].usage = usage;
+		resources[ id ].aspect = aspect;
+		resources[ id ].layers = layers;
+		resources[ id ].divisor = divisor;
+		return id;
+	}
+
+	// a transient's format from the next compile() on
+	void setFormat( ResourceId resource, vk::Format format )
+	{
+		resources[ resource ].format = format;
+	}
+
+	// what a transient is sized to for extent
+	vk::Extent2D imageExtent( ResourceId resource, vk::Extent2D extent ) const
+	{
+		auto &divisor = resources[ resource ].divisor;
+		return vk::Extent2D{ std::max( extent.width / divisor.width, 1u ), std::max( extent.height / divisor.height, 1u ) };
+	}
+
+	PassId addPass( const std::string &name, std::function<void( const FrameContext & )> execute )
+	{
+		passes.emplace_back();
+		passes.back().name = name;
+		passes.back().execute = std::move( execute );
+		return static_cast<PassId>( passes.size() - 1 );
+	}
+
+	void read( PassId pass, ResourceId resource, ResourceUse use )
+	{
+		passes[ pass ].uses.emplace_back( Use{ resource, use, false } );
+	}
+
+	void write( PassId pass, ResourceId resource, ResourceUse use )
+	{
+		passes[ pass ].uses.emplace_back( Use{ resource, use, true } );
+	}
+
+	// what the frame is for: writers of outputs survive culling, and outputs end in this state
+	void output( ResourceId resource, ResourceUse final_use )
+	{
+		resources[ resource ].is_output = true;
+		resources[ resource ].final_use = final_use;
+	}
+
+	void bind( ResourceId resource, vk::Image image, vk::ImageView view = {} )
+	{
+		resources[ resource ].image = image;
+		resources[ resource ].view = view;
+	}
+	void bind( ResourceId resource, vk::Buffer buffer ) { resources[ resource ].buffer = buffer; }
+
+	vk::Image image( ResourceId resource ) const { return resources[ resource ].image; }
+	vk::ImageView view( ResourceId resource ) const { return resources[ resource ].view; }
+	vk::Buffer buffer( ResourceId resource ) const { return resources[ resource ].buffer; }
+
+	void compile( vk::Device device, MemoryAllocator &allocator, vk::Extent2D extent )
+	{
+		destroyTransients();
+		this->device = device;
+		this->allocator = &allocator;
+		stats = Stats{};
+		stats.passes = static_cast<uint32_t>( passes.size() );
+
+		cullPasses();
+		sortPasses();
+		createTransients( extent );
+		planBarriers();
+	}
+
+	void execute( const FrameContext &context )
+	{
+		for ( auto pass : order ) {
+			recordBarriers( context.command_buffer, passes[ pass ].barriers );
+			passes[ pass ].execute( context );
+		}
+		recordBarriers( context.command_buffer, final_barriers );
+	}
+
+	const Stats &getStats() const { return stats; }
+
+	// names of the surviving passes in execution order
+	std::vector<std::string> passOrder() const
+	{
+		std::vector<std::string> names;
+		for ( auto pass : order ) {
+			names.emplace_back( passes[ pass ].name );
+		}
+		return names;
+	}
+
+	void destroyTransients()
+	{
+		releaseTransients()();
+	}
+
+	/* forgets the transients and returns what destroys them, for frames
+	   still in flight to finish with them first; the next compile() creates
+	   new ones regardless */
+	std::function<void()> releaseTransients()
+	{
+		std::vector<vk::ImageView> views;
+		std::vector<vk::Image> images;
+		for ( auto &resource : resources ) {
+			if ( !resource.transient ) {
+				continue;
+			}
+			if ( resource.view ) {
+				views.emplace_back( resource.view );
+			}
+			if ( resource.image ) {
+				images.emplace_back( resource.image );
+			}
+			resource.view = vk::ImageView{};
+			resource.image = vk::Image{};
+		}
+		auto memory = transient_memory;
+		transient_memory = Allocation{};
+		return [device = device, allocator = allocator, views, images, memory] {
+			for ( auto &view : views ) {
+				device.destroy( view );
+			}
+			for ( auto &image : images ) {
+				device.destroy( image );
+			}
+			if ( allocator ) {
+				allocator->free( memory );
+			}
+		};
+	}
+
+private:
+	struct Use
+	{
+		ResourceId resource;
+		ResourceUse use;
+		bool write;
+	};
+
+	struct Batch
+	{
+		vk::PipelineStageFlags src_stages;
+		vk::PipelineStageFlags dst_stages;
+		std::vector<std::pair<ResourceId, vk::ImageMemoryBarrier>> images;
+		std::vector<std::pair<ResourceId, vk::BufferMemoryBarrier>> buffers;
+		// execution only dependencies still need the stage masks
+		bool needed = false;
+	};
+
+	struct Pass
+	{
+		std::string name;
+		std::function<void( const FrameContext & )> execute;
+		std::vector<Use> uses;
+		bool live = false;
+		Batch barriers;
+	};
+
+	struct Resource
+	{
+		std::string name;
+		bool is_image;
+		bool transient;
+		bool is_output = false;
+		ResourceUse initial;
+		ResourceUse final_use;
+		vk::ImageAspectFlags aspect;
+		vk::Format format = vk::Format::eUndefined;
+		vk::ImageUsageFlags usage;
+		uint32_t layers = 1;
+		vk::Extent2D divisor{ 1, 1 };
+		vk::Image image;
+		vk::ImageView view;
+		vk::Buffer buffer;
+		// transient placement in the shared heap
+		vk::DeviceSize offset = 0;
+		vk::DeviceSize size = 0;
+	};
+
+	// synchronization state of a resource while walking the passes
+	struct State
+	{
+		vk::PipelineStageFlags write_stages;
+		vk::AccessFlags write_access;
+		// stages and accesses already ordered after the last write
+		vk::PipelineStageFlags read_stages;
+		vk::AccessFlags read_access;
+		vk::ImageLayout layout;
+	};
+
+	ResourceId addResource( const std::string &name, bool is_image, bool transient )
+	{
+		Resource resource;
+		resource.name = name;
+		resource.is_image = is_image;
+		resource.transient = transient;
+		resources.emplace_back( resource );
+		return static_cast<ResourceId>( resources.size() - 1 );
+	}
+
+	// walks back from the outputs; a pass lives if a live pass or an output needs what it writes
+	void cullPasses()
+	{
+		std::vector<bool> needed( resources.size(), false );
+		for ( size_t i = 0; i < resources.size(); ++i ) {
+			needed[ i ] = resources[ i ].is_output;
+		}
+		for ( size_t i = passes.size(); i-- > 0; ) {
+			auto &pass = passes[ i ];
+			pass.live = std::any_of( pass.uses.begin(), pass.uses.end(), [&]( const Use &use ) {
+				return use.write && needed[ use.resource ];
+			} );
+			if ( !pass.live ) {
+				++stats.culled_passes;
+				continue;
+			}
+			for ( auto &use : pass.uses ) {
+				if ( !use.write ) {
+					needed[ use.resource ] = true;
+				}
+			}
+		}
+	}
+
+	/* edges follow declaration order per resource: readers after the writer
+	   before them, writers after every earlier reader and writer. Kahn's
+	   algorithm, ties broken by declaration order */
+	void sortPasses()
+	{
+		std::vector<std::vector<PassId>> edges( passes.size() );
+		std::vector<uint32_t> incoming( passes.size(), 0 );
+		std::vector<int64_t> last_writer( resources.size(), -1 );
+		std::vector<std::vector<PassId>> readers( resources.size() );
+
+		auto link = [&]( int64_t from, PassId to ) {
+			if ( from >= 0 && from != to ) {
+				edges[ from ].emplace_back( to );
+				++incoming[ to ];
+			}
+		};
+		for ( PassId i = 0; i < passes.size(); ++i ) {
+			if ( !passes[ i ].live ) {
+				continue;
+			}
+			for ( auto &use : passes[ i ].uses ) {
+				if ( use.write ) {
+					link( last_writer[ use.resource ], i );
+					for ( auto reader : readers[ use.resource ] ) {
+						link( reader, i );
+					}
+					readers[ use.resource ].clear();
+					last_writer[ use.resource ] = i;
+				} else {
+					link( last_writer[ use.resource ], i );
+					readers[ use.resource ].emplace_back( i );
+				}
+			}
+		}
+
+		std::priority_queue<PassId, std::vector<PassId>, std::greater<PassId>> ready;
+		for ( PassId i = 0; i < passes.size(); ++i ) {
+			if ( passes[ i ].live && !incoming[ i ] ) {
+				ready.push( i );
+			}
+		}
+		order.clear();
+		while ( !ready.empty() ) {
+			auto pass = ready.top();
+			ready.pop();
+			order.emplace_back( pass );
+			for ( auto next : edges[ pass ] ) {
+				if ( !--incoming[ next ] ) {
+					ready.push( next );
+				}
+			}
+		}
+	}
+
+	void createTransients( vk::Extent2D extent )
+	{
+		std::vector<ResourceId> ids;
+		std::vector<AliasRequest> requests;
+		uint32_t memory_type_bits = ~0u;
+		for ( ResourceId id = 0; id < resources.size(); ++id ) {
+			auto &resource = resources[ id ];
+			if ( !resource.transient ) {
+				continue;
+			}
+			// a transient no surviving pass touches is never created
+			uint32_t first = ~0u, last = 0;
+			for ( uint32_t position = 0; position < order.size(); ++position ) {
+				for ( auto &use : passes[ order[ position ] ].uses ) {
+					if ( use.resource == id ) {
+						first = std::min( first, position );
+						last = std::max( last, position );
+					}
+				}
+			}
+			if ( first == ~0u ) {
+				continue;
+			}
+
+			auto image_extent = imageExtent( id, extent );
+			auto image_info =
+			  vk::ImageCreateInfo()
+				.setImageType( vk::ImageType::e2D )
+				.setFormat( resource.format )
+				.setExtent( vk::Extent3D{ image_extent.width, image_extent.height, 1 } )
+				.setMipLevels( 1 )
+				.setArrayLayers( resource.layers )
+				.setSamples( vk::SampleCountFlagBits::e1 )
+				.setTiling( vk::ImageTiling::eOptimal )
+				.setUsage( resource.usage )
+				.setSharingMode( vk::SharingMode::eExclusive )
+				.setInitialLayout( vk::ImageLayout::eUndefined );
+
+			if ( device.createImage( &image_info, nullptr, &resource.image ) != vk::Result::eSuccess ) {
+				throw std::runtime_error( "failed to create transient image " + resource.name );
+			}
+			auto requirements = device.getImageMemoryRequirements( resource.image );
+			memory_type_bits &= requirements.memoryTypeBits;
+			resource.size = requirements.size;
+			ids.emplace_back( id );
+			requests.emplace_back( AliasRequest{ requirements.size, requirements.alignment, first, last } );
+			stats.transient_bytes += requirements.size;
+			++stats.transient_images;
+		}
+		if ( ids.empty() ) {
+			return;
+		}
+		if ( !memory_type_bits ) {
+			throw std::runtime_error( "transient images share no memory type" );
+		}
+
+		std::vector<vk::DeviceSize> offsets;
+		vk::MemoryRequirements heap_requirements;
+		heap_requirements.size = assignAliasOffsets( requests, offsets );
+		heap_requirements.alignment = 1;
+		for ( auto &request : requests ) {
+			heap_requirements.alignment = std::max( heap_requirements.alignment, request.alignment );
+		}
+		heap_requirements.memoryTypeBits = memory_type_bits;
+		transient_memory = allocator->allocate( heap_requirements, vk::MemoryPropertyFlagBits::eDeviceLocal );
+		stats.aliased_bytes = heap_requirements.size;
+
+		for ( size_t i = 0; i < ids.size(); ++i ) {
+			auto &resource = resources[ ids[ i ] ];
+			resource.offset = offsets[ i ];
+			device.bindImageMemory( resource.image, transient_memory.memory, transient_memory.offset + resource.offset );
+
+			auto view_info =
+			  vk::ImageViewCreateInfo()
+				.setImage( resource.image )
+				.setViewType( resource.layers > 1 ? vk::ImageViewType::e2DArray : vk::ImageViewType::e2D )
+				.setFormat( resource.format );
+			view_info.subresourceRange
+			  .setAspectMask( resource.aspect )
+			  .setBaseMipLevel( 0 )
+			  .setLevelCount( 1 )
+			  .setBaseArrayLayer( 0 )
+			  .setLayerCount( resource.layers );
+
+			if ( device.createImageView( &view_info, nullptr, &resource.view ) != vk::Result::eSuccess ) {
+				throw std::runtime_error( "failed to create transient image view " + resource.name );
+			}
+		}
+	}
+
+	/* where a transient starts each frame: its memory was last touched by
+	   whichever overlapping transient (itself included) ran last, possibly in
+	   the previous frame, so wait on all of their uses */
+	State transientInitialState( ResourceId id )
+	{
+		auto &resource = resources[ id ];
+		State state{};
+		state.layout = vk::ImageLayout::eUndefined;
+		for ( ResourceId other = 0; other < resources.size(); ++other ) {
+			auto &alias = resources[ other ];
+			if ( !alias.transient || !alias.image ||
+				 alias.offset >= resource.offset + resource.size || resource.offset >= alias.offset + alias.size ) {
+				continue;
+			}
+			for ( auto pass : order ) {
+				for ( auto &use : passes[ pass ].uses ) {
+					if ( use.resource == other ) {
+						state.write_stages |= use.use.stages;
+						state.write_access |= writeAccess( use.use.access );
+					}
+				}
+			}
+		}
+		return state;
+	}
+
+	void addBarrier( Batch &batch, ResourceId id, State &state, const ResourceUse &use, bool write )
+	{
+		auto &resource = resources[ id ];
+		auto transition = resource.is_image && use.layout != state.layout;
+		auto written = bool( state.write_stages );
+
+		vk::PipelineStageFlags src_stages;
+		vk::AccessFlags src_access;
+		if ( transition || write ) {
+			// layout transitions and writes wait for everything before them
+			src_stages = state.write_stages | state.read_stages;
+			src_access = state.write_access;
+		} else if ( written && ( ( use.stages & ~state.read_stages ) || ( use.access & ~state.read_access ) ) ) {
+			// a read the last write has not been made visible to yet
+			src_stages = state.write_stages;
+			src_access = state.write_access;
+		}
+
+		if ( src_stages || transition ) {
+			batch.needed = true;
+			batch.src_stages |= src_stages ? src_stages : vk::PipelineStageFlags( vk::PipelineStageFlagBits::eTopOfPipe );
+			batch.dst_stages |= use.stages ? use.stages : vk::PipelineStageFlags( vk::PipelineStageFlagBits::eBottomOfPipe );
+
+			if ( resource.is_image && ( transition || src_access ) ) {
+				auto barrier =
+				  vk::ImageMemoryBarrier()
+					.setSrcAccessMask( src_access )
+					.setDstAccessMask( use.access )
+					.setOldLayout( state.layout )
+					.setNewLayout( use.layout )
+					.setSrcQueueFamilyIndex( VK_QUEUE_FAMILY_IGNORED )
+					.setDstQueueFamilyIndex( VK_QUEUE_FAMILY_IGNORED );
+				barrier.subresourceRange
+				  .setAspectMask( resource.aspect )
+				  .setBaseMipLevel( 0 )
+				  .setLevelCount( 1 )
+				  .setBaseArrayLayer( 0 )
+				  // arrays move all their layers together
+				  .setLayerCount( VK_REMAINING_ARRAY_LAYERS );
+				batch.images.emplace_back( id, barrier );
+			} else if ( !resource.is_image && src_access ) {
+				auto barrier =
+				  vk::BufferMemoryBarrier()
+					.setSrcAccessMask( src_access )
+					.setDstAccessMask( use.access )
+					.setSrcQueueFamilyIndex( VK_QUEUE_FAMILY_IGNORED )
+					.setDstQueueFamilyIndex( VK_QUEUE_FAMILY_IGNORED )
+					.setOffset( 0 )
+					.setSize( VK_WHOLE_SIZE );
+				batch.buffers.emplace_back( id, barrier );
+			}
+		}
+
+		if ( write || transition ) {
+			// a transition counts as a write that happens before the use
+			state.write_stages = use.stages;
+			state.write_access = writeAccess( use.access );
+			state.read_stages = write ? vk::PipelineStageFlags{} : use.stages;
+			state.read_access = write ? vk::AccessFlags{} : use.access;
+			state.layout = use.layout;
+		} else {
+			state.read_stages |= use.stages;
+			state.read_access |= use.access;
+		}
+	}
+
+	void planBarriers()
+	{
+		std::vector<State> states( resources.size() );
+		for ( ResourceId id = 0; id < resources.size(); ++id ) {
+			auto &resource = resources[ id ];
+			if ( resource.transient ) {
+				states[ id ] = transientInitialState( id );
+			} else {
+				states[ id ] = State{};
+				// imported images may still be in use at their initial stages, e.g. by presentation
+				states[ id ].write_stages = resource.initial.stages;
+				states[ id ].write_access = writeAccess( resource.initial.access );
+				states[ id ].layout = resource.initial.layout;
+			}
+		}
+
+		for ( auto pass : order ) {
+			auto &batch = passes[ pass ].barriers;
+			batch = Batch{};
+			for ( auto &use : passes[ pass ].uses ) {
+				addBarrier( batch, use.resource, states[ use.resource ], use.use, use.write );
+			}
+			countBatch( batch );
+		}
+
+		final_barriers = Batch{};
+		for ( ResourceId id = 0; id < resources.size(); ++id ) {
+			if ( resources[ id ].is_output ) {
+				addBarrier( final_barriers, id, states[ id ], resources[ id ].final_use, false );
+			}
+		}
+		countBatch( final_barriers );
+	}
+
+	void countBatch( const Batch &batch )
+	{
+		if ( batch.needed ) {
+			++stats.barrier_batches;
+			stats.barriers += static_cast<uint32_t>( batch.images.size() + batch.buffers.size() );
+		}
+	}
+
+	void recordBarriers( vk::CommandBuffer command_buffer, Batch &batch )
+	{
+		if ( !batch.needed ) {
+			return;
+		}
+		image_barriers.clear();
+		buffer_barriers.clear();
+		for ( auto &barrier : batch.images ) {
+			image_barriers.emplace_back( barrier.second.setImage( resources[ barrier.first ].image ) );
+		}
+		for ( auto &barrier : batch.buffers ) {
+			buffer_barriers.emplace_back( barrier.second.setBuffer( resources[ barrier.first ].buffer ) );
+		}
+		command_buffer.pipelineBarrier( batch.src_stages, batch.dst_stages, vk::DependencyFlags{},
+										0, nullptr,
+										buffer_barriers.size(), buffer_barriers.data(),
+										image_barriers.size(), image_barriers.data() );
+	}
+
+private:
+	vk::Device device;
+	MemoryAllocator *allocator = nullptr;
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+	std::vector<PassId> order;
+	Batch final_barriers;
+	Allocation transient_memory;
+	Stats stats;
+	// scratch for recording, kept to avoid allocating every frame
+	std::vector<vk::ImageMemoryBarrier> image_barriers;
+	std::vector<vk::BufferMemoryBarrier> buffer_barriers;
+};
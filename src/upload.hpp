@@ -0,0 +1,340 @@
+#pragma once
+
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "memory.hpp"
+
+/* byte ring over a staging buffer; head and tail only ever grow and are
+   wrapped on use, so a release mark is simply the head at submission time */
+struct UploadRing
+{
+	UploadRing( uint64_t capacity = 0 ) :
+	  capacity( capacity )
+	{
+	}
+
+	std::optional<uint64_t> allocate( uint64_t size, uint64_t alignment )
+	{
+		auto offset = head % capacity;
+		auto aligned = ( offset + alignment - 1 ) / alignment * alignment;
+		// a range never straddles the end, skip the tail bytes instead
+		if ( aligned + size > capacity ) {
+			aligned = 0;
+		}
+		auto skip = aligned >= offset ? aligned - offset : capacity - offset;
+		if ( head + skip + size - tail > capacity ) {
+			return std::nullopt;
+		}
+		head += skip + size;
+		return aligned;
+	}
+
+	uint64_t mark() const { return head; }
+	void release( uint64_t mark ) { tail = mark; }
+	uint64_t used() const { return head - tail; }
+
+	uint64_t capacity;
+
+private:
+	uint64_t head = 0;
+	uint64_t tail = 0;
+};
+
+/* streams buffer data through a host visible staging ring on the transfer
+   queue; each flush is one submission that signals the next value of the
+   upload timeline. Requests larger than what is free in the ring are split
+   and carried over to later frames, so the frame loop never waits for an
+   upload to fit */
+struct Uploader
+{
+	static constexpr vk::DeviceSize CHUNK_SIZE = 4ull << 20;
+
+	/* what a graphics submission has to do before touching uploaded data.
+	   The data is marked ready as soon as it is submitted, so any later frame
+	   may read it, not just the first: every frame waits on the newest upload
+	   value until a frame that waited on it has retired, and only then is the
+	   copy known complete for everyone after. The ownership acquires are
+	   recorded once, by the first of those frames; the ones after it are
+	   ordered behind them by submission order on the graphics queue */
+	struct Flush
+	{
+		// the upload timeline, null once every upload is covered by a retired frame
+		vk::Semaphore semaphore;
+		uint64_t value = 0;
+		// stages that read uploaded data, for the semaphore wait and the acquires
+		vk::PipelineStageFlags stages = vk::PipelineStageFlagBits::eVertexInput |
+										vk::PipelineStageFlagBits::eVertexShader |
+										vk::PipelineStageFlagBits::eComputeShader;
+		// queue family ownership acquires, only set for the frame after a submission
+		std::vector<vk::BufferMemoryBarrier> acquire_barriers;
+	};
+
+	void init( vk::Device device, MemoryAllocator &allocator,
+			   uint32_t transfer_family, uint32_t graphics_family,
+			   vk::Queue transfer_queue, vk::DeviceSize ring_size )
+	{
+		this->device = device;
+		this->transfer_family = transfer_family;
+		this->graphics_family = graphics_family;
+		this->transfer_queue = transfer_queue;
+		ring = UploadRing( ring_size );
+
+		auto type_info =
+		  vk::SemaphoreTypeCreateInfo()
+			.setSemaphoreType( vk::SemaphoreType::eTimeline )
+			.setInitialValue( 0 );
+		auto semaphore_info =
+		  vk::SemaphoreCreateInfo()
+			.setPNext( &type_info );
+
+		if ( device.createSemaphore( &semaphore_info, nullptr, &timeline ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to create upload timeline semaphore" );
+		}
+
+		auto buffer_info =
+		  vk::BufferCreateInfo()
+			.setSize( ring_size )
+			.setUsage( vk::BufferUsageFlagBits::eTransferSrc )
+			.setSharingMode( vk::SharingMode::eExclusive );
+
+		if ( device.createBuffer( &buffer_info, nullptr, &staging_buffer ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to create staging buffer" );
+		}
+		staging_allocation = allocator.allocateBuffer( staging_buffer,
+													   vk::MemoryPropertyFlagBits::eHostVisible |
+														 vk::MemoryPropertyFlagBits::eHostCoherent );
+
+		auto pool_info =
+		  vk::CommandPoolCreateInfo()
+			.setFlags( vk::CommandPoolCreateFlagBits::eTransient |
+					   vk::CommandPoolCreateFlagBits::eResetCommandBuffer )
+			.setQueueFamilyIndex( transfer_family );
+
+		if ( device.createCommandPool( &pool_info, nullptr, &command_pool ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to create transfer command pool" );
+		}
+	}
+
+	/* copies size bytes from data into dst at dst_offset; data must stay valid
+	   until done runs, which keep_alive can take care of */
+	void uploadBuffer( vk::Buffer dst, vk::DeviceSize dst_offset, const void *data, vk::DeviceSize size,
+					   std::function<void()> done = {}, std::shared_ptr<const void> keep_alive = {} )
+	{
+		requests.emplace_back( Request{ dst, dst_offset, static_cast<const char *>( data ), size, 0,
+										std::move( done ), std::move( keep_alive ) } );
+	}
+
+	Flush flush( uint64_t frame )
+	{
+		Flush result;
+		if ( !requests.empty() ) {
+			submit( result );
+		}
+		if ( submitted > covered ) {
+			result.semaphore = timeline;
+			result.value = submitted;
+			waits.emplace_back( frame, submitted );
+		}
+		return result;
+	}
+
+	/* recycles batches in submission order once a frame that waited on them
+	   has retired: that frame's completion covers the copy as well, since it
+	   waited on the upload timeline. This also frees the staging range */
+	void collect( uint64_t completed_frames )
+	{
+		while ( !waits.empty() && waits.front().first < completed_frames ) {
+			covered = waits.front().second;
+			waits.pop_front();
+		}
+		while ( !in_flight.empty() ) {
+			auto &batch = batches[ in_flight.front() ];
+			if ( batch.value > covered ) {
+				break;
+			}
+			ring.release( batch.ring_mark );
+			free_batches.emplace_back( in_flight.front() );
+			in_flight.pop_front();
+		}
+	}
+
+	bool idle() const { return requests.empty(); }
+	vk::DeviceSize stagingUsed() const { return ring.used(); }
+
+	void destroy( MemoryAllocator &allocator )
+	{
+		batches.clear();
+		device.destroy( timeline );
+		device.destroy( command_pool );
+		device.destroy( staging_buffer );
+		allocator.free( staging_allocation );
+	}
+
+private:
+	struct Request
+	{
+		vk::Buffer dst;
+		vk::DeviceSize dst_offset;
+		const char *data;
+		vk::DeviceSize size;
+		vk::DeviceSize copied;
+		std::function<void()> done;
+		std::shared_ptr<const void> keep_alive;
+	};
+
+	struct Batch
+	{
+		vk::CommandBuffer command_buffer;
+		uint64_t ring_mark = 0;
+		// the upload timeline value the copy signals
+		uint64_t value = 0;
+	};
+
+	// records and submits as many pending requests as fit in the ring
+	void submit( Flush &result )
+	{
+		auto batch_index = acquireBatch();
+		auto &batch = batches[ batch_index ];
+		auto begin_info =
+		  vk::CommandBufferBeginInfo()
+			.setFlags( vk::CommandBufferUsageFlagBits::eOneTimeSubmit );
+		if ( batch.command_buffer.begin( &begin_info ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to begin recording upload command buffer" );
+		}
+
+		std::vector<std::function<void()>> completed;
+		size_t chunk_count = 0;
+		while ( !requests.empty() ) {
+			auto &request = requests.front();
+			auto chunk = std::min( request.size - request.copied, CHUNK_SIZE );
+			auto offset = ring.allocate( chunk, 16 );
+			if ( !offset ) {
+				// ring is full: the rest goes out with a later frame
+				break;
+			}
+			memcpy( static_cast<char *>( staging_allocation.mapped ) + *offset, request.data + request.copied, chunk );
+
+			auto region =
+			  vk::BufferCopy()
+				.setSrcOffset( *offset )
+				.setDstOffset( request.dst_offset + request.copied )
+				.setSize( chunk );
+			batch.command_buffer.copyBuffer( staging_buffer, request.dst, 1, &region );
+
+			if ( transfer_family != graphics_family ) {
+				auto barrier =
+				  vk::BufferMemoryBarrier()
+					.setSrcAccessMask( vk::AccessFlagBits::eTransferWrite )
+					.setSrcQueueFamilyIndex( transfer_family )
+					.setDstQueueFamilyIndex( graphics_family )
+					.setBuffer( request.dst )
+					.setOffset( region.dstOffset )
+					.setSize( chunk );
+				batch.command_buffer.pipelineBarrier( vk::PipelineStageFlagBits::eTransfer,
+													  vk::PipelineStageFlagBits::eBottomOfPipe,
+													  vk::DependencyFlags{}, 0, nullptr, 1, &barrier, 0, nullptr );
+				// the matching acquire carries the destination access instead
+				result.acquire_barriers.emplace_back( barrier.setSrcAccessMask( vk::AccessFlags{} )
+														.setDstAccessMask( vk::AccessFlagBits::eVertexAttributeRead |
+																		   vk::AccessFlagBits::eIndexRead |
+																		   vk::AccessFlagBits::eUniformRead |
+																		   vk::AccessFlagBits::eShaderRead ) );
+			}
+
+			request.copied += chunk;
+			++chunk_count;
+			if ( request.copied == request.size ) {
+				if ( request.done ) {
+					completed.emplace_back( std::move( request.done ) );
+				}
+				requests.pop_front();
+			}
+		}
+
+		if ( vkEndCommandBuffer( batch.command_buffer ) != VK_SUCCESS ) {
+			throw std::runtime_error( "failed to record upload command buffer" );
+		}
+		// not even one chunk fit, try again next frame
+		if ( !chunk_count ) {
+			free_batches.emplace_back( batch_index );
+			return;
+		}
+
+		auto value = submitted + 1;
+		auto timeline_info =
+		  vk::TimelineSemaphoreSubmitInfo()
+			.setSignalSemaphoreValueCount( 1 )
+			.setPSignalSemaphoreValues( &value );
+		auto submit_info =
+		  vk::SubmitInfo()
+			.setPNext( &timeline_info )
+			.setCommandBufferCount( 1 )
+			.setPCommandBuffers( &batch.command_buffer )
+			.setSignalSemaphoreCount( 1 )
+			.setPSignalSemaphores( &timeline );
+
+		if ( transfer_queue.submit( 1, &submit_info, vk::Fence{} ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to submit upload" );
+		}
+		submitted = value;
+		batch.ring_mark = ring.mark();
+		batch.value = value;
+		in_flight.emplace_back( batch_index );
+
+		// the data is usable by every frame that waits on this value
+		for ( auto &done : completed ) {
+			done();
+		}
+	}
+
+	size_t acquireBatch()
+	{
+		if ( !free_batches.empty() ) {
+			auto index = free_batches.back();
+			free_batches.pop_back();
+			batches[ index ].command_buffer.reset( vk::CommandBufferResetFlags{} );
+			return index;
+		}
+
+		Batch batch;
+		auto alloc_info =
+		  vk::CommandBufferAllocateInfo()
+			.setCommandPool( command_pool )
+			.setLevel( vk::CommandBufferLevel::ePrimary )
+			.setCommandBufferCount( 1 );
+
+		if ( device.allocateCommandBuffers( &alloc_info, &batch.command_buffer ) != vk::Result::eSuccess ) {
+			throw std::runtime_error( "failed to create upload batch" );
+		}
+		batches.emplace_back( batch );
+		return batches.size() - 1;
+	}
+
+private:
+	vk::Device device;
+	uint32_t transfer_family = 0;
+	uint32_t graphics_family = 0;
+	vk::Queue transfer_queue;
+	vk::Semaphore timeline;
+	// the last value signaled, and the last one a retired frame waited on
+	uint64_t submitted = 0;
+	uint64_t covered = 0;
+	// frame and the value it waited on, oldest first
+	std::deque<std::pair<uint64_t, uint64_t>> waits;
+	vk::CommandPool command_pool;
+	vk::Buffer staging_buffer;
+	Allocation staging_allocation;
+	UploadRing ring;
+	std::deque<Request> requests;
+	std::vector<Batch> batches;
+	std::vector<size_t> free_batches;
+	std::deque<size_t> in_flight;
+};
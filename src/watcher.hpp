@@ -0,0 +1,65 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+/* reports files written into one directory, without blocking. Only
+   completed writes count: a file closed after writing, or one renamed into
+   place, so a half written file is never picked up */
+struct FileWatcher
+{
+	explicit FileWatcher( const std::string &directory )
+	{
+		fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+		if ( fd < 0 ) {
+			throw std::runtime_error( std::string( "failed to create inotify instance: " ) + strerror( errno ) );
+		}
+		if ( inotify_add_watch( fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO ) < 0 ) {
+			auto err = errno;
+			close( fd );
+			throw std::runtime_error( "failed to watch " + directory + ": " + strerror( err ) );
+		}
+	}
+	~FileWatcher()
+	{
+		close( fd );
+	}
+
+	FileWatcher( const FileWatcher & ) = delete;
+	FileWatcher &operator=( const FileWatcher & ) = delete;
+
+	// names of the files written since the last call, each at most once
+	std::vector<std::string> poll()
+	{
+		std::vector<std::string> changed;
+		alignas( inotify_event ) char buffer[ 4096 ];
+		while ( true ) {
+			auto length = read( fd, buffer, sizeof( buffer ) );
+			if ( length <= 0 ) {
+				// EAGAIN: nothing more queued
+				break;
+			}
+			for ( ssize_t offset = 0; offset < length; ) {
+				auto event = reinterpret_cast<const inotify_event *>( buffer + offset );
+				if ( event->len ) {
+					std::string name = event->name;
+					if ( std::find( changed.begin(), changed.end(), name ) == changed.end() ) {
+						changed.emplace_back( std::move( name ) );
+					}
+				}
+				offset += sizeof( inotify_event ) + event->len;
+			}
+		}
+		return changed;
+	}
+
+private:
+	int fd = -1;
+};
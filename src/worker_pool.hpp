@@ -0,0 +1,98 @@
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* fixed set of threads that all run the same job and are joined before run()
+   returns; the job gets the worker index, so per-thread state such as command
+   pools can be indexed by it without any locking */
+struct WorkerPool
+{
+	explicit WorkerPool( uint32_t thread_count )
+	{
+		for ( uint32_t i = 0; i < thread_count; ++i ) {
+			threads.emplace_back( [this, i] { loop( i ); } );
+		}
+	}
+	~WorkerPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			stopping = true;
+		}
+		work_cv.notify_all();
+		for ( auto &thread : threads ) {
+			thread.join();
+		}
+	}
+
+	WorkerPool( const WorkerPool & ) = delete;
+	WorkerPool &operator=( const WorkerPool & ) = delete;
+
+	uint32_t size() const { return static_cast<uint32_t>( threads.size() ); }
+
+	// runs job( worker_index ) once on every worker and blocks until all are done
+	void run( const std::function<void( uint32_t )> &job )
+	{
+		std::unique_lock<std::mutex> lock( mutex );
+		current_job = &job;
+		pending = threads.size();
+		++generation;
+		work_cv.notify_all();
+		done_cv.wait( lock, [this] { return pending == 0; } );
+		current_job = nullptr;
+
+		if ( error ) {
+			auto e = error;
+			error = nullptr;
+			std::rethrow_exception( e );
+		}
+	}
+
+private:
+	void loop( uint32_t index )
+	{
+		uint64_t seen = 0;
+		while ( true ) {
+			const std::function<void( uint32_t )> *job;
+			{
+				std::unique_lock<std::mutex> lock( mutex );
+				work_cv.wait( lock, [&] { return stopping || generation != seen; } );
+				if ( stopping ) {
+					return;
+				}
+				seen = generation;
+				job = current_job;
+			}
+
+			try {
+				( *job )( index );
+			} catch ( ... ) {
+				std::lock_guard<std::mutex> lock( mutex );
+				if ( !error ) {
+					error = std::current_exception();
+				}
+			}
+
+			std::lock_guard<std::mutex> lock( mutex );
+			if ( --pending == 0 ) {
+				done_cv.notify_one();
+			}
+		}
+	}
+
+private:
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable work_cv;
+	std::condition_variable done_cv;
+	const std::function<void( uint32_t )> *current_job = nullptr;
+	size_t pending = 0;
+	uint64_t generation = 0;
+	bool stopping = false;
+	std::exception_ptr error;
+};